@@ -37,33 +37,46 @@ const char* frag_shader_text =
     "  gl_FragColor = vec4(1.0, 0.0, 0.0, 1.0);\n"
     "}\n";
 
-void redraw(WaylandWindow* window) {
-  // Set the viewport.
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
-
-  // Clear the color buffer.
-  glClearColor(0.0, 0.0, 0.0, 1.0);
-  glClear(GL_COLOR_BUFFER_BIT);
+MeshHandle triangle;
 
+void CreateTriangle(GL* gl) {
   static const GLfloat verts[] = { 0.0f, 0.5f, 0.0f,
                                    -0.5, -0.5f, 0.0f,
                                    0.5f, -0.5f, 0.0f };
+  const VertexAttrib attribs[] = {
+      {gl->pos, 3, GL_FLOAT, GL_FALSE, 0, 0, 0}};
+
+  MeshData data = {};
+  data.vertices[0] = verts;
+  data.vertex_bytes[0] = sizeof(verts);
+  data.vertex_count = 3;
+  data.attribs = attribs;
+  data.attrib_count = 1;
+  triangle = gl->meshes.create_mesh(data);
+}
+
+void redraw(WaylandWindow* window) {
   GL* gl = WaylandPlatform::getInstance()->getGL();
-  glVertexAttribPointer(gl->pos, 3, GL_FLOAT, GL_FALSE, 0, verts);
-  glEnableVertexAttribArray(gl->pos);
 
-  glDrawArrays(GL_TRIANGLES, 0, 3);
+  // Set the viewport.
+  gl->state.viewport(0, 0, window->geometry.width, window->geometry.height);
+
+  // Clear the color buffer.
+  gl->state.clear_color(0.0, 0.0, 0.0, 1.0);
+  glClear(GL_COLOR_BUFFER_BIT);
 
-  glDisableVertexAttribArray(gl->pos);
+  gl->meshes.draw(triangle, GL_TRIANGLES);
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
   
   int width = 250;
   int height = 250;
   waylandPlatform->createWindow(width, height,vert_shader_text,
       frag_shader_text, redraw);
+  CreateTriangle(waylandPlatform->getGL());
 
   waylandPlatform->run();
   waylandPlatform->terminate();
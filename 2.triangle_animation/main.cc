@@ -20,31 +20,23 @@
  * OF THIS SOFTWARE.
  */
 
-#include <chrono>
-#include <ctime>
-#include <iostream>
-//#include <sys/time.h>
+#include <cmath>
+#include <cstddef>
 
 #include "../common/wayland_platform.h"
 #include "../common/display.h"
 #include "../common/window.h"
 
-using std::chrono::duration_cast;
-using std::chrono::milliseconds;
-using std::chrono::seconds;
-using std::chrono::system_clock;
-
 // The main purpose of the vertex shader is to transform 3D coordinates
 // into different 3D coordinates (more on that later) and the vertex shader
 // allows us to do some basic processing on the vertex attributes.
 // https://learnopengl.com/#!Getting-started/Hello-Triangle
 const char* vert_shader_text =
-    "uniform mat4 rotation;\n"
     "attribute vec4 pos;\n"
     "attribute vec4 color;\n"
     "varying vec4 v_color;\n"
     "void main() {\n"
-    "  gl_Position = rotation * pos;\n"
+    "  gl_Position = pos;\n"
     "  v_color = color;\n"
     "}\n";
 
@@ -55,42 +47,48 @@ const char* frag_shader_text =
     "  gl_FragColor = v_color;\n"
     "}\n";
 
+struct Vertex {
+  GLfloat pos[3];
+  GLfloat color[3];
+};
+
 void redraw(WaylandWindow* window) {
   static const GLfloat verts[3][2] = {{-0.5, -0.5}, {0.5, -0.5}, {0, 0.5}};
   static const GLfloat colors[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
   GLfloat angle;
-  GLfloat rotation[4][4] = {
-      {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
   static const int32_t speed_div = 5;
-  static auto start_time = 0;
-
-  struct wl_region* region;
-
-  if (start_time == 0)
-    start_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-  auto cur_time = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-
-  std::cout << "start time = " << start_time << std::endl;
-  std::cout << "cur_time = " << cur_time << std::endl; 
-  angle = ((cur_time - start_time) / speed_div) % 360 * M_PI / 180.0;
-  std::cout << "angle=" << angle << std::endl;
-  rotation[0][0] = cos(angle);
-  rotation[0][2] = sin(angle);
-  rotation[2][0] = -sin(angle);
-  rotation[2][2] = cos(angle);
 
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
+  // The window's clock, so that --bench draws the same angles every run.
+  int64_t milliseconds = static_cast<int64_t>(window->clock.now() * 1000);
+  angle = (milliseconds / speed_div) % 360 * M_PI / 180.0;
 
   GL* gl = WaylandPlatform::getInstance()->getGL();
 
-  glUniformMatrix4fv(gl->rotation_uniform, 1, GL_FALSE,
-                     (GLfloat*)rotation);
+  gl->state.viewport(0, 0, window->geometry.width, window->geometry.height);
 
-  glClearColor(0.0, 0.0, 0.0, 0.5);
+  gl->state.clear_color(0.0, 0.0, 0.0, 0.5);
   glClear(GL_COLOR_BUFFER_BIT);
 
-  glVertexAttribPointer(gl->pos, 2, GL_FLOAT, GL_FALSE, 0, verts);
-  glVertexAttribPointer(gl->col, 3, GL_FLOAT, GL_FALSE, 0, colors);
+  // The geometry changes every frame, so it is rotated about the y axis
+  // here and written into this frame's part of the stream buffer.
+  GLintptr offset;
+  Vertex* vertices = static_cast<Vertex*>(
+      gl->stream.map(3 * sizeof(Vertex), sizeof(GLfloat), &offset));
+  for (int i = 0; i < 3; i++) {
+    vertices[i].pos[0] = verts[i][0] * cos(angle);
+    vertices[i].pos[1] = verts[i][1];
+    vertices[i].pos[2] = verts[i][0] * sin(angle);
+    vertices[i].color[0] = colors[i][0];
+    vertices[i].color[1] = colors[i][1];
+    vertices[i].color[2] = colors[i][2];
+  }
+  gl->stream.unmap();
+
+  glVertexAttribPointer(gl->pos, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        reinterpret_cast<const void*>(offset));
+  glVertexAttribPointer(
+      gl->col, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+      reinterpret_cast<const void*>(offset + offsetof(Vertex, color)));
   glEnableVertexAttribArray(gl->pos);
   glEnableVertexAttribArray(gl->col);
 
@@ -101,7 +99,8 @@ void redraw(WaylandWindow* window) {
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
 
   int width = 250;
   int height = 250;
@@ -25,34 +25,47 @@ const char* fragmentShaderSource =
     "   out_color = vec4(1.0f, 0.0f, 0.0f, 1.0f); \n"
     "}                                               \n";
 
-void redraw(WaylandWindow* window) {
-  float vertices[] = {
+MeshHandle triangle;
+
+void CreateTriangle(GL* gl) {
+  static const float vertices[] = {
       0.0f,  0.5f,  0.0f,  // left
       -0.5f, -0.5f, 0.0f,  // right
       0.5f,  -0.5f, 0.0f   // top
   };
+  const VertexAttrib attribs[] = {{0, 2, GL_FLOAT, GL_FALSE, 0, 0, 0}};
 
+  MeshData data = {};
+  data.vertices[0] = vertices;
+  data.vertex_bytes[0] = sizeof(vertices);
+  data.vertex_count = 3;
+  data.attribs = attribs;
+  data.attrib_count = 1;
+  triangle = gl->meshes.create_mesh(data);
+}
+
+void redraw(WaylandWindow* window) {
   WaylandPlatform* platform = WaylandPlatform::getInstance();
 
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
+  platform->getGL()->state.viewport(0, 0, window->geometry.width,
+                                    window->geometry.height);
 
-  glClearColor(0.0, 0.0, 0.0, 0.5);
+  platform->getGL()->state.clear_color(0.0, 0.0, 0.0, 0.5);
   glClear(GL_COLOR_BUFFER_BIT);
 
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-  glEnableVertexAttribArray(0);
-  glDrawArrays(GL_TRIANGLES, 0, 3);
-  glDisableVertexAttribArray(0);
+  platform->getGL()->meshes.draw(triangle, GL_TRIANGLES);
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
  
   int width = 250;
   int height = 250;
 
   waylandPlatform->createWindow(width, height,vertexShaderSource,
       fragmentShaderSource, redraw);
+  CreateTriangle(waylandPlatform->getGL());
 
   waylandPlatform->run();
   waylandPlatform->terminate();
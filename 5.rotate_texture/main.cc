@@ -99,10 +99,14 @@ GLuint CreateSimpleTexture2D() {
   return textureId;
 }
 
-void redraw(WaylandWindow* window) {
-  WaylandPlatform* platform = WaylandPlatform::getInstance();
+MeshHandle quad;
+
+// Uniform locations, looked up once.
+GLint samplerLoc;
+GLint rotationLoc;
 
-  GLfloat vVertices[] = {
+void CreateQuad(GL* gl) {
+  static const GLfloat vVertices[] = {
       -0.5f, 0.5f,  0.0f,  // Position 0
       0.0f,  0.0f,         // TexCoord 0
       -0.5f, -0.5f, 0.0f,  // Position 1
@@ -116,7 +120,40 @@ void redraw(WaylandWindow* window) {
   // The below sets of indices have the same result:
   // GLushort indices[] = {0, 1, 2, 0, 2, 3};
   // GLushort indices[] = {0, 2, 3, 0, 1, 2};
-  GLushort indices[] = {1 ,2, 0, 2, 3, 0};
+  static const GLushort indices[] = {1 ,2, 0, 2, 3, 0};
+
+  // Describe the vertex layout
+  // index
+  // size: the number of components per generic vertext attribute.
+  // type
+  // normalized
+  // stride: specified the byte offset between cosecutive gnertic vertext
+  //         attributes.
+  // offset: specifies a offset of the first component of the first generic
+  //         vertex attributes.
+  const VertexAttrib attribs[] = {
+      // The vertex position
+      {0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 0, 0},
+      // The texture coordinate
+      {1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 3 * sizeof(GLfloat), 0},
+  };
+
+  // Upload the vertices and indices once; every frame only binds them.
+  MeshData data = {};
+  data.vertices[0] = vVertices;
+  data.vertex_bytes[0] = sizeof(vVertices);
+  data.vertex_count = 4;
+  data.attribs = attribs;
+  data.attrib_count = 2;
+  data.indices = indices;
+  data.index_count = 6;
+  data.index_type = GL_UNSIGNED_SHORT;
+  quad = gl->meshes.create_mesh(data);
+}
+
+void redraw(WaylandWindow* window) {
+  GL* gl = WaylandPlatform::getInstance()->getGL();
+
   GLfloat angle;
   GLfloat rotation[4][4] = {
       {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}};
@@ -141,56 +178,42 @@ void redraw(WaylandWindow* window) {
   rotation[1][1] = cos(angle);
 
   // Set the viewport.
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
+  gl->state.viewport(0, 0, window->geometry.width, window->geometry.height);
 
-  glUniformMatrix4fv(platform->getGL()->rotation_uniform, 1, GL_FALSE,
-                     (GLfloat*)rotation);
+  glUniformMatrix4fv(rotationLoc, 1, GL_FALSE, (GLfloat*)rotation);
 
   // Clear the color buffer.
-  glClearColor(0.0, 0.0, 0.0, 1.0);
+  gl->state.clear_color(0.0, 0.0, 0.0, 1.0);
   glClear(GL_COLOR_BUFFER_BIT);
 
-  // Load the vertex position
-  // index
-  // size: the number of components per generic vertext attribute.
-  // type
-  // normalized
-  // stride: specified the byte offset between cosecutive gnertic vertext
-  //         attributes.
-  // pointer: specifies a offset of the first component of the first generic
-  //          vertex attributes.
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
-                        vVertices);
-  // Load the texture coordinate
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat),
-                        &vVertices[3]);
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-
   // Bind the texture
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, platform->getGL()->texture_id);
-  // Set the sampler texture unit to 0
-  glUniform1i(platform->getGL()->sampler, 0);
-
-  // Render primitives from array data.
-  // mode: specifies what kind of primitive to render.
-  // count: specifies the number of elements to be rendered.
-  // type: specifies the type of the value in indices.
-  // indices: specifies the type of the values in indices.
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+  gl->state.active_texture(GL_TEXTURE0);
+  gl->state.bind_texture(GL_TEXTURE_2D, gl->texture_id);
+
+  // Render primitives from the quad's index buffer.
+  gl->meshes.draw(quad, GL_TRIANGLES);
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
   
   int width = 250;
   int height = 250;
   waylandPlatform->createWindow(width, height,vert_shader_text,
       frag_shader_text, redraw);
 
-  waylandPlatform->getGL()->texture_id = CreateSimpleTexture2D();
+  // Load the resources first; the shaders are compiling meanwhile.
+  GL* gl = waylandPlatform->getGL();
+  gl->texture_id = CreateSimpleTexture2D();
+  CreateQuad(gl);
+  samplerLoc = gl->shaders.uniform_location(gl->getProgram(), "s_texture");
+  rotationLoc = gl->shaders.uniform_location(gl->getProgram(), "rotation");
+
+  // The sampler always reads texture unit 0, so it is set once rather than
+  // every frame.
+  gl->shaders.use(gl->getProgram());
+  glUniform1i(samplerLoc, 0);
   waylandPlatform->run();
   waylandPlatform->terminate();
 
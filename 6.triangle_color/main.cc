@@ -43,19 +43,19 @@ const char* fragmentShaderSource =
       "    o_fragColor = v_color; \n"
       "}" ;
 
-void redraw(WaylandWindow* window) {
-  WaylandPlatform* platform = WaylandPlatform::getInstance();
+MeshHandle triangle;
 
+void CreateTriangle(GL* gl) {
   // 3 vertices, with (x,y,z) ,(r, g, b, a) per-vertex
   // triangle
-  GLfloat vertexPos[3 * VERTEX_POS_SIZE] =
+  static const GLfloat vertexPos[3 * VERTEX_POS_SIZE] =
   {
      0.0f,  0.5f, 0.0f,        // v0
      -0.5f, -0.5f, 0.0f,       // v1
      0.5f, -0.5f, 0.0f         // v2
   };
 
-  GLfloat color[4 * VERTEX_COLOR_SIZE] =
+  static const GLfloat color[4 * VERTEX_COLOR_SIZE] =
   {
      1.0f, 0.0f, 0.0f, 1.0f,   // c0
      0.0f, 1.0f, 0.0f, 1.0f,   // c1
@@ -69,68 +69,60 @@ void redraw(WaylandWindow* window) {
   };
 
   // Index buffer data
-  GLushort indices[3] = { 0, 1, 2 };
-  GLfloat *vtxBuf[2] = { vertexPos, color };
-
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
-  glClear(GL_COLOR_BUFFER_BIT);
+  static const GLushort indices[3] = { 0, 1, 2 };
 
   // DrawPrimitiaveWithVBOs
   int numVertices = 3;
   int numIndices = 3;
 
-  if (platform->getGL()->vertexBuffer[0] == 0 &&
-      platform->getGL()->vertexBuffer[1] == 0 &&
-      platform->getGL()->vertexBuffer[2] == 0) {
-    // Only allocate on the first draw
-    glGenBuffers(3, platform->getGL()->vertexBuffer);
-    // Copy our vertices array in a buffer for GPU to use.
-    glBindBuffer(GL_ARRAY_BUFFER, platform->getGL()->vertexBuffer[0]);
-    glBufferData(GL_ARRAY_BUFFER, vtxStrides[0] * numVertices,
-                 vtxBuf[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, platform->getGL()->vertexBuffer[1]);
-    glBufferData(GL_ARRAY_BUFFER, vtxStrides[1] * numVertices,
-                 vtxBuf[1], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, platform->getGL()->vertexBuffer[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * numIndices,
-                 indices, GL_STATIC_DRAW);
-  } 
-
-  glBindBuffer(GL_ARRAY_BUFFER, platform->getGL()->vertexBuffer[0]);
-  glEnableVertexAttribArray(VERTEX_POS_INDEX);
   // #define VERTEX_POS_INDEX       0
   // 0 is the location in the vertex shader:
-  // layout(location = 0) in vec4 a_position; 
-  glVertexAttribPointer(VERTEX_POS_INDEX, VERTEX_POS_SIZE,
-                          GL_FLOAT, GL_FALSE, vtxStrides[0], 0 );
-
+  // layout(location = 0) in vec4 a_position;
   // #define VERTEX_COLOR_INDEX     1
   // 1 is the location in the vertex shader:
   // layout(location = 1) in vec4 a_color;
-  glBindBuffer(GL_ARRAY_BUFFER, platform->getGL()->vertexBuffer[1]);
-  glEnableVertexAttribArray(VERTEX_COLOR_INDEX);
-  glVertexAttribPointer(VERTEX_COLOR_INDEX, VERTEX_COLOR_SIZE,
-                        GL_FLOAT, GL_FALSE, vtxStrides[1], 0 );
+  // Positions and colors live in separate vertex buffers (streams 0 and 1).
+  const VertexAttrib attribs[] = {
+      {VERTEX_POS_INDEX, VERTEX_POS_SIZE, GL_FLOAT, GL_FALSE, vtxStrides[0],
+       0, 0},
+      {VERTEX_COLOR_INDEX, VERTEX_COLOR_SIZE, GL_FLOAT, GL_FALSE,
+       vtxStrides[1], 0, 1},
+  };
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, platform->getGL()->vertexBuffer[2]);
+  // Copy our vertices array in a buffer for GPU to use, once.
+  MeshData data = {};
+  data.vertices[0] = vertexPos;
+  data.vertex_bytes[0] = vtxStrides[0] * numVertices;
+  data.vertices[1] = color;
+  data.vertex_bytes[1] = vtxStrides[1] * numVertices;
+  data.vertex_count = numVertices;
+  data.attribs = attribs;
+  data.attrib_count = 2;
+  data.indices = indices;
+  data.index_count = numIndices;
+  data.index_type = GL_UNSIGNED_SHORT;
+  triangle = gl->meshes.create_mesh(data);
+}
 
-  glDrawElements(GL_TRIANGLES, numIndices,
-                 GL_UNSIGNED_SHORT, 0 );
+void redraw(WaylandWindow* window) {
+  WaylandPlatform* platform = WaylandPlatform::getInstance();
 
-  glDisableVertexAttribArray(VERTEX_POS_INDEX);
-  glDisableVertexAttribArray(VERTEX_COLOR_INDEX);
+  platform->getGL()->state.viewport(0, 0, window->geometry.width,
+                                    window->geometry.height);
+  glClear(GL_COLOR_BUFFER_BIT);
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  platform->getGL()->meshes.draw(triangle, GL_TRIANGLES);
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
   
   int width = 250;
   int height = 250;
   waylandPlatform->createWindow(width, height, vertexShaderSource,
       fragmentShaderSource, redraw);
+  CreateTriangle(waylandPlatform->getGL());
 
   waylandPlatform->run();
   waylandPlatform->terminate();
@@ -31,61 +31,73 @@ const char* fragmentShaderSource =
     "   out_color = vec4(1.0f, 0.0f, 0.0f, 1.0f);    \n"
     "}                                               \n";
 
-void redraw(WaylandWindow* window) {
-  WaylandPlatform* platform = WaylandPlatform::getInstance();
+// Nothing in the transform changes between frames, so the whole MVP is
+// computed at compile time.
+constexpr ged::Mat<4> kMvp =
+    // Translate away from the viewer
+    ged::Mat<4>::Identity()
+        .Translate(0.0f, 0.0f, -2.0f)
+        // Rotate the triangle. Rotate takes degrees, but this sample has
+        // always passed 60 degrees in radians; keep the picture unchanged.
+        .Rotate(60.0f * ged::constexpr_math::kPi / 180.0, 1.0f, 0.0f, 1.0f)
+        // Compute the final MVP by multiplying the modelview and a
+        // perspective matrix with a 60 degree FOV together. The aspect ratio
+        // used to be width / height in integer arithmetic, which is 1 for
+        // every landscape window.
+        .MatrixMultiply(ged::Mat<4>::Identity().Perspective(60.0f, 1.0f, 1.0f,
+                                                            20.0f));
+
+MeshHandle triangle;
 
-  ged::Matrix modelview;
-  ged::Matrix projection;
+// Uniform location, looked up once.
+GLint mvpLoc;
 
-  float vertices[] = {
+void CreateTriangle(GL* gl) {
+  static const float vertices[] = {
       0.0f,  0.5f,  0.0f,  // left
       -0.5f, -0.5f, 0.0f,  // right
       0.5f,  -0.5f, 0.0f   // top
   };
+  const VertexAttrib attribs[] = {{0, 2, GL_FLOAT, GL_FALSE, 0, 0, 0}};
 
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
-
-  glClearColor(0.0, 0.0, 0.0, 0.5);
-  glClear(GL_COLOR_BUFFER_BIT);
-  
-  float aspect = window->geometry.width / window->geometry.height;
+  MeshData data = {};
+  data.vertices[0] = vertices;
+  data.vertex_bytes[0] = sizeof(vertices);
+  data.vertex_count = 3;
+  data.attribs = attribs;
+  data.attrib_count = 1;
+  triangle = gl->meshes.create_mesh(data);
+}
 
-  // Generate a perspective matrix with a 60 degree FOV.
-  float field_of_view = 60.0f;
-  projection.Perspective(field_of_view, aspect, 1.0f, 20.0f);
- 
-  // Translate away from the viewer
-  modelview.Translate(0.0, 0.0, -2.0 );
+void redraw(WaylandWindow* window) {
+  WaylandPlatform* platform = WaylandPlatform::getInstance();
 
-  // Rotate the cube
-  GLfloat angle = 60 * M_PI / 180.0;
-  modelview.Rotate(angle, 1.0, 0.0, 1.0);
+  platform->getGL()->state.viewport(0, 0, window->geometry.width,
+                                    window->geometry.height);
 
-  // Compute the final MVP by multiplying the
-  // modevleiw and perspective matrices together
-  modelview.MatrixMultiply(projection);
+  platform->getGL()->state.clear_color(0.0, 0.0, 0.0, 0.5);
+  glClear(GL_COLOR_BUFFER_BIT);
 
   // Load the MVP matrix
-  glUniformMatrix4fv(platform->getGL()->mvpLoc, 1, GL_FALSE,
-     modelview.Data());
+  glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, kMvp.Data());
 
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-  glEnableVertexAttribArray(0);
-  glDrawArrays(GL_TRIANGLES, 0, 3);
-  glDisableVertexAttribArray(0);
+  platform->getGL()->meshes.draw(triangle, GL_TRIANGLES);
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
   
   int width = 250;
   int height = 250;
   waylandPlatform->createWindow(width, height, vertexShaderSource,
       fragmentShaderSource, redraw);
   
-  // Get the uniform locations
-  waylandPlatform->getGL()->mvpLoc = 
-       glGetUniformLocation(waylandPlatform->getGL()->program, "u_mvpMatrix");
+  // Create the triangle while the shaders compile, then get the uniform
+  // locations, which waits for them.
+  GL* gl = waylandPlatform->getGL();
+  CreateTriangle(gl);
+  mvpLoc = gl->shaders.uniform_location(gl->getProgram(), "u_mvpMatrix");
   waylandPlatform->run();
   waylandPlatform->terminate();
 
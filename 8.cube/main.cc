@@ -21,7 +21,25 @@
  * OF THIS SOFTWARE.
  */
 
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
 #include "../common/matrix.h"
+#include "../common/mesh_optimizer.h"
+#include "../common/quaternion.h"
+#include "../common/stream_buffer.h"
+#include "../common/transform_batch.h"
 #include "../common/display.h"
 #include "../common/wayland_platform.h"
 #include "../common/window.h"
@@ -39,6 +57,20 @@ const char* vertexShaderSource =
     "  vVaryingColor = color;                   \n"
     "}";
 
+// Used with --instances. The MVP is a per-instance attribute, so every cube
+// is drawn by one call.
+const char* instancedVertexShaderSource =
+    "#version 300 es                            \n"
+    "layout(location = 0) in vec4 pos;          \n"
+    "layout(location = 1) in vec4 color;        \n"
+    "layout(location = 2) in mat4 mvpMatrix;    \n"
+    "out vec4 vVaryingColor;                    \n"
+    "void main()                                \n"
+    "{                                          \n"
+    "  gl_Position = mvpMatrix * pos;           \n"
+    "  vVaryingColor = color;                   \n"
+    "}";
+
 const char* fragmentShaderSource =
     "#version 300 es                                 \n"
     "precision mediump float;                        \n"
@@ -49,14 +81,69 @@ const char* fragmentShaderSource =
     "   out_color = vVaryingColor;                   \n"
     "}                                               \n";
 
-void redraw(WaylandWindow* window) {
-  WaylandPlatform* platform = WaylandPlatform::getInstance();
-  static int i = 0;
+// Draw a large cube. The projection never changes, so it is built at compile
+// time. The aspect ratio used to be width / height in integer arithmetic,
+// which is 1 for every landscape window.
+constexpr ged::Matrix kProjection(
+    ged::Mat<4>::Identity().Perspective(29.0f, 1.0f, 1.0f, 20.0f));
 
-  ged::Matrix modelview;
-  ged::Matrix projection;
+struct CubeVertex {
+  GLfloat pos[3];
+  GLfloat color[3];
+};
 
- static const GLfloat vertices[] = {
+// What is uploaded: 12 bytes a vertex instead of 24.
+struct PackedVertex {
+  GLushort pos[4];  // Half floats.
+  GLubyte color[4];
+};
+
+// Uploaded instead where there are no half float attributes: 20 bytes.
+struct FloatPosVertex {
+  GLfloat pos[4];
+  GLubyte color[4];
+};
+
+// The attribute type of half floats, or 0 if the context has none. ES 2.0
+// only has them with OES_vertex_half_float, under another enum.
+GLenum HalfFloatType(GL* gl) {
+  if (gl->isGLES3())
+    return GL_HALF_FLOAT;
+  const char* extensions =
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  if (extensions && strstr(extensions, "GL_OES_vertex_half_float"))
+    return GL_HALF_FLOAT_OES;
+  return 0;
+}
+
+MeshHandle cube;
+
+// Uniform location, looked up once.
+GLint mvpLoc;
+
+// Number of cubes drawn instanced, or 0 to draw a single cube with the MVP
+// in a uniform.
+int instanceCount = 0;
+ged::TransformBatch instances;
+// Fixed extra rotation of each instance, so they do not all look the same.
+std::vector<ged::Quaternion> instanceOffsets;
+// Holds the per-instance matrices of the frames in flight.
+StreamBuffer instanceBuffer;
+const int kInstanceBufferFrames = 3;
+const GLsizeiptr kInstanceBytes = 16 * sizeof(GLfloat);
+// The most instances the buffer, and the count of the draw, can hold.
+const GLsizeiptr kMaxInstances = std::min<GLsizeiptr>(
+    INT_MAX, std::numeric_limits<GLsizeiptr>::max() /
+                 (kInstanceBufferFrames * kInstanceBytes));
+// A multiple of four, so that no group of four records ComputeMVP loads
+// spans two jobs.
+const size_t kInstancesPerJob = 256;
+
+// Height of the view at the depth of the cube.
+const float kViewHeight = 4.0f;
+
+void CreateCube(GL* gl) {
+  static const GLfloat vertices[] = {
       // front
       -1.0f, -1.0f, +1.0f, // point blue
       +1.0f, -1.0f, +1.0f, // point magenta
@@ -122,61 +209,246 @@ void redraw(WaylandWindow* window) {
       1.0f, 0.0f, 1.0f
   };
 
-  float aspect;
+  // Expand the face strips into a triangle list, merge the corners the
+  // triangles share and order them for the post-transform vertex cache.
+  const int kCorners = 6 * 6;
+  CubeVertex corners[kCorners];
+  for (int face = 0; face < 6; face++) {
+    static const int quad[] = {0, 1, 2, 2, 1, 3};
+    for (int i = 0; i < 6; i++) {
+      int v = face * 4 + quad[i];
+      memcpy(corners[face * 6 + i].pos, &vertices[v * 3], sizeof(GLfloat) * 3);
+      memcpy(corners[face * 6 + i].color, &vColors[v * 3],
+             sizeof(GLfloat) * 3);
+    }
+  }
 
-  glViewport(0, 0, window->geometry.width, window->geometry.height);
+  CubeVertex unique[kCorners];
+  unsigned indices[kCorners];
+  size_t count = ged::DeduplicateVertices(corners, kCorners,
+                                          sizeof(CubeVertex), unique, indices);
+  ged::OptimizeVertexCache(indices, indices, kCorners, count, 16);
+  count = ged::OptimizeVertexFetch(unique, indices, kCorners, unique, count,
+                                   sizeof(CubeVertex));
 
-  glClearColor(0.5, 0.5, 0.5, 1.0);
-  glClear(GL_COLOR_BUFFER_BIT);
-  glEnable(GL_CULL_FACE);
-  
-  aspect = window->geometry.width / window->geometry.height;
+  // Half float positions and byte colors halve the vertex size. Without
+  // half float attributes only the colors are packed.
+  GLenum halfType = HalfFloatType(gl);
+  PackedVertex packed[kCorners];
+  FloatPosVertex floatPos[kCorners];
+  for (size_t v = 0; v < count; v++) {
+    for (int c = 0; c < 3; c++) {
+      packed[v].pos[c] = ged::QuantizeHalf(unique[v].pos[c]);
+      packed[v].color[c] = ged::QuantizeUnorm8(unique[v].color[c]);
+      floatPos[v].pos[c] = unique[v].pos[c];
+      floatPos[v].color[c] = packed[v].color[c];
+    }
+    packed[v].pos[3] = ged::QuantizeHalf(1.0f);
+    packed[v].color[3] = 255;
+    floatPos[v].pos[3] = 1.0f;
+    floatPos[v].color[3] = 255;
+  }
+  GLushort packedIndices[kCorners];
+  for (int i = 0; i < kCorners; i++)
+    packedIndices[i] = indices[i];
+
+  const VertexAttrib packedAttribs[] = {
+      {0, 4, halfType, GL_FALSE, sizeof(PackedVertex),
+       offsetof(PackedVertex, pos), 0},
+      {1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex),
+       offsetof(PackedVertex, color), 0},
+  };
+  const VertexAttrib floatPosAttribs[] = {
+      {0, 4, GL_FLOAT, GL_FALSE, sizeof(FloatPosVertex),
+       offsetof(FloatPosVertex, pos), 0},
+      {1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FloatPosVertex),
+       offsetof(FloatPosVertex, color), 0},
+  };
 
+  MeshData data = {};
+  if (halfType) {
+    data.vertices[0] = packed;
+    data.vertex_bytes[0] = count * sizeof(PackedVertex);
+    data.attribs = packedAttribs;
+  } else {
+    data.vertices[0] = floatPos;
+    data.vertex_bytes[0] = count * sizeof(FloatPosVertex);
+    data.attribs = floatPosAttribs;
+  }
+  data.vertex_count = count;
+  data.attrib_count = 2;
+  data.indices = packedIndices;
+  data.index_count = kCorners;
+  data.index_type = GL_UNSIGNED_SHORT;
+  cube = gl->meshes.create_mesh(data);
+}
+
+// Lays the instances out on a square grid that fills the view.
+void CreateInstances() {
+  int columns = 1;
+  while (static_cast<GLsizeiptr>(columns) * columns < instanceCount)
+    columns++;
+  float cell = kViewHeight / columns;
+
+  instances.Resize(instanceCount);
+  instanceOffsets.resize(instanceCount);
+  for (int i = 0; i < instanceCount; i++) {
+    float x = (i % columns - (columns - 1) * 0.5f) * cell;
+    float y = (i / columns - (columns - 1) * 0.5f) * cell;
+    instances.SetPosition(i, x, y, -8.0f);
+    instances.SetScale(i, 1.0f / columns, 1.0f / columns, 1.0f / columns);
+    instanceOffsets[i] =
+        ged::Quaternion::FromAxisAngle(7.0f * i, 1.0f, 1.0f, 0.0f);
+  }
+
+  instanceBuffer.init(GL_ARRAY_BUFFER,
+                      static_cast<GLsizeiptr>(instanceCount) *
+                          kInstanceBufferFrames * kInstanceBytes,
+                      true);
+}
+
+void DrawInstances(GL* gl, const ged::Quaternion& rotation) {
+  GpuPass pass(&gl->profiler, "instances");
+
+  // The matrices are written straight into the mapped buffer, by every
+  // worker for its own range of instances.
+  GLintptr offset;
+  float* mvp = static_cast<float*>(instanceBuffer.map(
+      static_cast<GLsizeiptr>(instanceCount) * kInstanceBytes, 16, &offset));
+  WaylandPlatform::getInstance()->getJobs()->parallel_for(
+      0, instanceCount, kInstancesPerJob, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+          instances.SetRotation(i, instanceOffsets[i] * rotation);
+        instances.ComputeMVP(kProjection, mvp, 16, begin, end);
+      });
+  instanceBuffer.unmap();
+
+  VertexAttrib mvpAttribs[kMatrixAttribCount];
+  matrix_instance_attribs(2, offset, mvpAttribs);
+  gl->meshes.draw_instanced(cube, GL_TRIANGLES, instanceCount,
+                            instanceBuffer.buffer(), mvpAttribs,
+                            kMatrixAttribCount);
+  instanceBuffer.end_frame();
+}
+
+// Returns the rotation for the next frame.
+ged::Quaternion NextRotation(const FrameClock& clock) {
   //Render a small cube.
   //esFrustum(&perspective, -2.8f, +2.8f, -2.8f * aspect, +2.8f * aspect, 6.0f,
   //          12.0f);
-  // Draw a large cube.
-  projection.Perspective(29.0f, aspect, 1.0f, 20.0f);
-  i++;
+  // The angles used to step once per frame drawn; now they follow the
+  // window's clock, at the same speed at 60 frames per second.
+  float i = clock.now() * 60.0f;
+  // Rotate around X, then Y, then Z. Composing the quaternions costs far less
+  // than three Rotate calls, each of which is a full matrix update.
+  return ged::Quaternion::FromAxisAngle(10.0f + (0.15f * i), 0.0f, 0.0f, 1.0f) *
+         ged::Quaternion::FromAxisAngle(45.0f - (0.5f * i), 0.0f, 1.0f, 0.0f) *
+         ged::Quaternion::FromAxisAngle(45.0f + (0.25f * i), 1.0f, 0.0f, 0.0f);
+}
+
+// Runs on the update thread, while the previous frame is drawn, so it makes
+// no GL calls.
+void UpdateCube(WaylandWindow* window, RenderQueue* queue) {
+  ged::Matrix modelview;
+
   modelview.Translate(0.0f, 0.0f, -8.0f);
-  modelview.Rotate(45.0f + (0.25f * i), 1.0f, 0.0f, 0.0f);
-  modelview.Rotate(45.0f - (0.5f * i), 0.0f, 1.0f, 0.0f);
-  modelview.Rotate(10.0f + (0.15f * i), 0.0f, 0.0f, 1.0f);
+  modelview.Rotate(NextRotation(window->clock));
 
  // Compute the final MVP by multiplying the
   // modevleiw and perspective matrices together
-  modelview.MatrixMultiply(projection);
-
-  // Load the MVP matrix
-  glUniformMatrix4fv(platform->getGL()->mvpLoc, 1, GL_FALSE,
-     modelview.Data());
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertices);
-  glEnableVertexAttribArray(0);
-  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-  glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-  glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-  glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-  glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-  glDisableVertexAttribArray(0);
-
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, vColors);
-  glEnableVertexAttribArray(1);
+  modelview.MatrixMultiply(kProjection);
+
+  // Record the draw with its MVP matrix. The render thread replays the
+  // queue, which binds the mesh and loads the matrix.
+  const UniformValue mvp = {mvpLoc, GL_FLOAT_MAT4, modelview.Data()};
+  RenderQueue::Draw draw = {};
+  draw.program = WaylandPlatform::getInstance()->getGL()->getProgram();
+  draw.mesh = cube;
+  draw.mode = GL_TRIANGLES;
+  draw.depth = 8.0f;
+  draw.uniforms = &mvp;
+  draw.uniform_count = 1;
+  queue->record(draw);
+}
+
+void redraw(WaylandWindow* window) {
+  WaylandPlatform* platform = WaylandPlatform::getInstance();
+
+  platform->getGL()->state.viewport(0, 0, window->geometry.width,
+                                    window->geometry.height);
+
+  platform->getGL()->state.clear_color(0.5, 0.5, 0.5, 1.0);
+  glClear(GL_COLOR_BUFFER_BIT);
+  platform->getGL()->state.enable(GL_CULL_FACE);
+
+  // The instances are written into a mapped buffer, so they are updated
+  // here on the render thread.
+  if (instanceCount)
+    DrawInstances(platform->getGL(), NextRotation(window->clock));
+}
+
+void Usage(int error_code) {
+  fprintf(stderr,
+          "Usage: cube [OPTIONS]\n\n"
+          "  --instances N\tDraw N cubes with one instanced draw call\n"
+          "  --present MODE\tfifo, callback or mailbox\n"
+          "  --bench N\tMeasure N frames and print the times as JSON\n"
+          "  --warmup M\tDraw M frames before measuring\n"
+          "  -h\t\tThis help text\n\n");
+  exit(error_code);
 }
 
 int main(int argc, char** argv) {
-  std::unique_ptr<WaylandPlatform> waylandPlatform = WaylandPlatform::create();
-  
+  // Takes out --bench and --warmup.
+  std::unique_ptr<WaylandPlatform> waylandPlatform =
+      WaylandPlatform::create(&argc, argv);
+
+  const char* presentMode = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp("--instances", argv[i]) == 0 && i + 1 < argc) {
+      char* end;
+      errno = 0;
+      long count = strtol(argv[++i], &end, 10);
+      if (*end || errno == ERANGE || count < 1 || count > kMaxInstances)
+        Usage(EXIT_FAILURE);
+      instanceCount = count;
+    } else if (strcmp("--present", argv[i]) == 0 && i + 1 < argc) {
+      presentMode = argv[++i];
+    } else if (strcmp("-h", argv[i]) == 0) {
+      Usage(EXIT_SUCCESS);
+    } else {
+      Usage(EXIT_FAILURE);
+    }
+  }
+
   int width = 500;
   int height = 500;
-  waylandPlatform->createWindow(width, height, vertexShaderSource,
+  waylandPlatform->createWindow(width, height,
+      instanceCount ? instancedVertexShaderSource : vertexShaderSource,
       fragmentShaderSource, redraw);
+  if (presentMode) {
+    PresentMode mode;
+    if (!WaylandPlatform::parsePresentMode(presentMode, &mode))
+      Usage(EXIT_FAILURE);
+    waylandPlatform->setPresentMode(mode);
+  }
+  GL* gl = waylandPlatform->getGL();
+  if (instanceCount && !gl->isGLES3()) {
+    fprintf(stderr, "Error: --instances needs OpenGL ES 3.0\n");
+    exit(1);
+  }
   
-  // Get the uniform locations
-  waylandPlatform->getGL()->mvpLoc = 
-       glGetUniformLocation(waylandPlatform->getGL()->program, "u_mvpMatrix");
+  // Create the cube while the shaders compile, then get the uniform
+  // locations, which waits for them.
+  CreateCube(gl);
+  if (instanceCount)
+    CreateInstances();
+  mvpLoc = gl->shaders.uniform_location(gl->getProgram(), "u_mvpMatrix");
+  if (!instanceCount)
+    waylandPlatform->setUpdate(UpdateCube);
   waylandPlatform->run();
+  if (instanceCount)
+    instanceBuffer.destroy();
   waylandPlatform->terminate();
 
   return 0;
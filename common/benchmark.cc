@@ -0,0 +1,107 @@
+#include "benchmark.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "gpu_profiler.h"
+
+Benchmark::Benchmark()
+    : frames_(0),
+      warmup_(0),
+      frame_(0),
+      frame_start_(0),
+      first_start_(0),
+      last_end_(0),
+      profiler_(nullptr) {}
+
+void Benchmark::init(unsigned frames, unsigned warmup, GpuProfiler* profiler) {
+  frames_ = frames;
+  warmup_ = warmup;
+  cpu_.reserve(frames);
+  gpu_.reserve(frames);
+  profiler_ = profiler;
+  profiler_->set_frame_callback(&Benchmark::gpu_frame, this);
+}
+
+int64_t Benchmark::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void Benchmark::begin_frame() {
+  if (!enabled() || frame_ >= warmup_ + frames_)
+    return;
+
+  frame_start_ = now();
+  if (frame_ == warmup_)
+    first_start_ = frame_start_;
+}
+
+void Benchmark::end_frame() {
+  if (!enabled() || frame_ >= warmup_ + frames_)
+    return;
+
+  if (frame_ >= warmup_)
+    cpu_.push_back((now() - frame_start_) / 1e6);
+}
+
+bool Benchmark::end_swap() {
+  if (!enabled() || frame_ >= warmup_ + frames_)
+    return false;
+
+  frame_++;
+  if (frame_ < warmup_ + frames_)
+    return false;
+  last_end_ = now();
+  return true;
+}
+
+// The profiler numbers frames from 1, so frame n is the benchmark's
+// frame n - 1.
+void Benchmark::gpu_frame(void* data, unsigned frame, double milliseconds) {
+  Benchmark* benchmark = static_cast<Benchmark*>(data);
+  if (frame > benchmark->warmup_ &&
+      frame <= benchmark->warmup_ + benchmark->frames_)
+    benchmark->gpu_.push_back(milliseconds);
+}
+
+void Benchmark::print_stats(const char* name, std::vector<double>* samples) {
+  if (samples->empty()) {
+    printf("\"%s\": null", name);
+    return;
+  }
+  std::sort(samples->begin(), samples->end());
+  size_t n = samples->size();
+  double median = n % 2 ? (*samples)[n / 2]
+                        : ((*samples)[n / 2 - 1] + (*samples)[n / 2]) / 2;
+  // Nearest rank.
+  size_t p99 = static_cast<size_t>(ceil(0.99 * n)) - 1;
+  printf("\"%s\": {\"min\": %.4f, \"median\": %.4f, \"p99\": %.4f, "
+         "\"max\": %.4f, \"samples\": %zu}",
+         name, samples->front(), median, (*samples)[p99], samples->back(), n);
+}
+
+void Benchmark::report(const char* present_mode, bool headless) {
+  if (!enabled())
+    return;
+  profiler_->finish();
+
+  unsigned measured = cpu_.size();
+  double seconds = last_end_ > first_start_ ? (last_end_ - first_start_) / 1e9
+                                            : 0;
+  printf("{\"frames\": %u, \"warmup\": %u, \"present_mode\": \"%s\", "
+         "\"headless\": %s, ",
+         measured, warmup_, present_mode, headless ? "true" : "false");
+  print_stats("cpu_ms", &cpu_);
+  printf(", ");
+  print_stats("gpu_ms", &gpu_);
+  // Measured frames the profiler could not time.
+  unsigned gpu_missing = profiler_->enabled() ? measured - gpu_.size() : 0;
+  printf(", \"gpu_dropped\": %u, \"fps\": %.2f}\n", gpu_missing,
+         last_end_ && seconds > 0 ? measured / seconds : 0.0);
+  fflush(stdout);
+}
@@ -0,0 +1,54 @@
+#ifndef OPENGL_WAYLAND_BENCHMARK_H_
+#define OPENGL_WAYLAND_BENCHMARK_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+class GpuProfiler;
+
+// Measures a fixed number of frames after some warmup frames, for the
+// --bench option every sample takes.
+//
+// The CPU time of a frame runs from begin_frame() to end_frame(), which
+// brackets everything up to the swap. Its GPU time is the sum of its passes
+// from the GpuProfiler, which has to be enabled for it and begin the same
+// frames. Frames per second count every measured frame from the start of
+// the first to the end of the last, swaps and waits for the display
+// included, so they depend on the present mode.
+class Benchmark {
+ public:
+  Benchmark();
+
+  void init(unsigned frames, unsigned warmup, GpuProfiler* profiler);
+  bool enabled() const { return frames_ > 0; }
+
+  // Called on the render thread. end_swap() returns true once the last
+  // measured frame is done; frames after it are not measured.
+  void begin_frame();
+  void end_frame();
+  bool end_swap();
+
+  // Prints the results to stdout as one JSON object. Waits for the GPU
+  // times still in flight, so the context must be current.
+  void report(const char* present_mode, bool headless);
+
+ private:
+  // In nanoseconds.
+  static int64_t now();
+  static void gpu_frame(void* data, unsigned frame, double milliseconds);
+  void print_stats(const char* name, std::vector<double>* samples);
+
+  unsigned frames_;
+  unsigned warmup_;
+  // Frames begun so far, including warmup.
+  unsigned frame_;
+  int64_t frame_start_;
+  int64_t first_start_;
+  int64_t last_end_;
+  std::vector<double> cpu_;  // In milliseconds.
+  std::vector<double> gpu_;
+  GpuProfiler* profiler_;
+};
+
+#endif
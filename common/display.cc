@@ -7,11 +7,15 @@
 #include "display.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <iostream>
+#include <algorithm>
 
 #include <linux/input.h>
 
+#include "log.h"
+#include "presentation-time-client-protocol.h"
 #include "wayland_platform.h"
 
 const struct wl_registry_listener registry_listener = {
@@ -109,7 +113,7 @@ static void keyboard_handle_key(void* data,
   if (key == KEY_F11 && state)
     window->toggle_fullscreen();
   else if (key == KEY_ESC && state)
-    running = 0;
+    display->Quit();
 }
 
 static void keyboard_handle_modifiers(void* data,
@@ -152,26 +156,63 @@ static const struct wl_seat_listener seat_listener = {
 };
 
 
-WaylandDisplay::WaylandDisplay() {
+static void presentation_handle_clock_id(void* data,
+                                         struct wp_presentation* presentation,
+                                         uint32_t clk_id) {
+  WaylandDisplay* display = static_cast<WaylandDisplay*>(data);
+  display->presentation_clock = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+    presentation_handle_clock_id,
+};
+
+WaylandDisplay::WaylandDisplay()
+    : display_(nullptr),
+      presentation(nullptr),
+      presentation_clock(CLOCK_MONOTONIC),
+      headless(false),
+      frameSource_(nullptr),
+      frameInterval_(0) {
 
 }
 
-void WaylandDisplay::InitializeDisplay() {
+bool WaylandDisplay::InitializeDisplay() {
   display_ = wl_display_connect(NULL);
-  assert(display_);
+  if (!display_)
+    return false;
+  loop.init();
  
   registry = wl_display_get_registry(display_);
   wl_registry_add_listener(registry, &registry_listener, this);
   wl_display_dispatch(display_);
+  // Wait for the clock the presentation times are on.
+  if (presentation)
+    wl_display_roundtrip(display_);
 
-  std::cout << "end of " << __func__ << std::endl;
+  LOG_DEBUG("Connected to the compositor%s",
+            presentation ? ", with wp_presentation" : "");
+  return true;
 }
 
-void WaylandDisplay::CreateAcceleratedSurface(unsigned width, unsigned height) {
-  cursor_surface = wl_compositor_create_surface(compositor);
+void WaylandDisplay::InitializeHeadless() {
+  headless = true;
+  loop.init();
 
+  const char* fps = getenv("OPENGL_WAYLAND_HEADLESS_FPS");
+  int rate = fps ? atoi(fps) : 60;
+  frameInterval_ = rate > 0 ? 1000000000ull / rate : 0;
+}
+
+void WaylandDisplay::CreateAcceleratedSurface(unsigned width, unsigned height) {
   window_ = std::make_unique<WaylandWindow>();
   window_->display = this;
+  if (headless) {
+    window_->create_offscreen(width, height);
+    return;
+  }
+
+  cursor_surface = wl_compositor_create_surface(compositor);
   window_->create_surface(width, height);
 }
 
@@ -179,13 +220,48 @@ WaylandWindow* WaylandDisplay::GetWindow() {
   return window_.get();
 }
 
+void WaylandDisplay::HeadlessFrame(void* data) {
+  WaylandDisplay* display = static_cast<WaylandDisplay*>(data);
+  display->window_->frame_due();
+}
+
 void WaylandDisplay::Run() {
-  int ret = 0;
-  while (running && ret != -1)
-    ret = wl_display_dispatch(display_);
+  if (headless) {
+    if (frameInterval_) {
+      frameSource_ =
+          loop.add_timer(0, frameInterval_, HeadlessFrame, this);
+    } else {
+      frameSource_ = loop.add_event(HeadlessFrame, this);
+      loop.signal(frameSource_);
+    }
+    // The source goes in Terminate(), once the render thread is done
+    // calling FrameDone().
+    loop.run();
+    return;
+  }
+
+  loop.set_display(display_);
+  if (!loop.run())
+    LOG_ERROR("Lost the connection to the compositor");
+}
+
+void WaylandDisplay::FrameDone() {
+  if (!frameInterval_ && frameSource_)
+    loop.signal(frameSource_);
+}
+
+void WaylandDisplay::Quit() {
+  loop.quit();
 }
 
 void WaylandDisplay::Terminate() {
+  if (headless) {
+    // The window's offscreen target went with the GL objects.
+    if (frameSource_)
+      loop.remove(frameSource_);
+    return;
+  }
+
   window_->destroy_surface();
 
   wl_surface_destroy(cursor_surface);
@@ -195,6 +271,9 @@ void WaylandDisplay::Terminate() {
   if (shell)
     wl_shell_destroy(shell);
 
+  if (presentation)
+    wp_presentation_destroy(presentation);
+
   if (compositor)
     wl_compositor_destroy(compositor);
 
@@ -212,12 +291,13 @@ void WaylandDisplay::registry_handle_global(void* data,
                             uint32_t name,
                             const char* interface,
                             uint32_t version) {
-  std::cout << __func__ << std::endl;
+  LOG_DEBUG("Global %u: %s version %u", name, interface, version);
   WaylandDisplay* d = static_cast<WaylandDisplay*>(data);
 
   if (strcmp(interface, "wl_compositor") == 0) {
     d->compositor =
-        static_cast<wl_compositor*>(wl_registry_bind(registry, name, &wl_compositor_interface, 1));
+        static_cast<wl_compositor*>(wl_registry_bind(
+            registry, name, &wl_compositor_interface, std::min(version, 4u)));
   } else if (strcmp(interface, "wl_shell") == 0) {
     d->shell = static_cast<wl_shell*>(wl_registry_bind(registry, name, &wl_shell_interface, 1));
   } else if (strcmp(interface, "wl_seat") == 0) {
@@ -227,5 +307,9 @@ void WaylandDisplay::registry_handle_global(void* data,
     d->shm = static_cast<wl_shm*>(wl_registry_bind(registry, name, &wl_shm_interface, 1));
     d->cursor_theme = wl_cursor_theme_load(NULL, 32, d->shm);
     d->default_cursor = wl_cursor_theme_get_cursor(d->cursor_theme, "left_ptr");
+  } else if (strcmp(interface, "wp_presentation") == 0) {
+    d->presentation = static_cast<wp_presentation*>(
+        wl_registry_bind(registry, name, &wp_presentation_interface, 1));
+    wp_presentation_add_listener(d->presentation, &presentation_listener, d);
   }
 }
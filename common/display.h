@@ -1,6 +1,8 @@
 #ifndef OPENGL_WAYLAND_DISPLAY_H_
 #define OPENGL_WAYLAND_DISPLAY_H_
 
+#include <time.h>
+
 #include <memory>
 
 #include <EGL/egl.h>
@@ -9,16 +11,28 @@
 #include <wayland-cursor.h>
 #include <wayland-egl.h>
 
+#include "event_loop.h"
+
 class WaylandWindow;
+struct wp_presentation;
 
 class WaylandDisplay {
  public:
   WaylandDisplay();
-  void InitializeDisplay();
+  // Returns false if there is no compositor to connect to.
+  bool InitializeDisplay();
+  // Renders offscreen instead, with no compositor. Frames are driven by a
+  // timer at OPENGL_WAYLAND_HEADLESS_FPS, 60 by default, or as fast as
+  // they finish if it is 0.
+  void InitializeHeadless();
   void CreateAcceleratedSurface(unsigned width, unsigned height);
   WaylandWindow* GetWindow();
   void Terminate();
+  // Dispatches events until Quit() or a connection error.
   void Run();
+  void Quit();
+  // Called by a headless window when it finished a frame.
+  void FrameDone();
   static void registry_handle_global(
       void *data,
       struct wl_registry *registry,
@@ -41,13 +55,25 @@ class WaylandDisplay {
   struct wl_cursor_theme* cursor_theme;
   struct wl_cursor* default_cursor;
   struct wl_surface* cursor_surface;
+  // NULL if the compositor does not report presentation times.
+  struct wp_presentation* presentation;
+  clockid_t presentation_clock;
   struct {
     EGLDisplay dpy;
     EGLContext ctx;
     EGLConfig conf;
   } egl;
+  // Waits for the connection and any other sources added to it.
+  EventLoop loop;
+  bool headless;
 
  private:
+   static void HeadlessFrame(void* data);
+
+   // Starts the next headless frame: a timer, or an event FrameDone()
+   // signals when uncapped.
+   EventLoop::Source* frameSource_;
+   uint64_t frameInterval_;
    // FIXME: will support multiple windows.
    std::unique_ptr<WaylandWindow> window_;
 };
@@ -0,0 +1,259 @@
+#include "event_loop.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <wayland-client.h>
+
+#include "trace.h"
+
+namespace {
+
+const int kMaxEvents = 16;
+const uint64_t kNanosecondsPerSecond = 1000000000;
+
+struct timespec to_timespec(uint64_t ns) {
+  struct timespec ts;
+  ts.tv_sec = ns / kNanosecondsPerSecond;
+  ts.tv_nsec = ns % kNanosecondsPerSecond;
+  return ts;
+}
+
+}  // namespace
+
+class EventLoop::Source {
+ public:
+  SourceType type;
+  int fd;
+  FdCallback fd_callback;
+  Callback callback;
+  void* data;
+};
+
+EventLoop::EventLoop()
+    : epoll_fd_(-1),
+      wake_fd_(-1),
+      quit_(false),
+      display_(nullptr),
+      dispatch_callback_(nullptr),
+      dispatch_data_(nullptr) {}
+
+EventLoop::~EventLoop() {
+  while (!sources_.empty())
+    remove(sources_.back().get());
+  if (wake_fd_ >= 0)
+    close(wake_fd_);
+  if (epoll_fd_ >= 0)
+    close(epoll_fd_);
+}
+
+void EventLoop::init() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  assert(epoll_fd_ >= 0);
+  wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  assert(wake_fd_ >= 0);
+
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+}
+
+void EventLoop::set_display(struct wl_display* display) {
+  assert(!display_);
+  display_ = display;
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = this;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wl_display_get_fd(display), &ev);
+}
+
+void EventLoop::set_dispatch_callback(Callback callback, void* data) {
+  dispatch_callback_ = callback;
+  dispatch_data_ = data;
+}
+
+EventLoop::Source* EventLoop::add_source(SourceType type,
+                                         int fd,
+                                         uint32_t events) {
+  Source* source = new Source();
+  source->type = type;
+  source->fd = fd;
+  source->fd_callback = nullptr;
+  source->callback = nullptr;
+  source->data = nullptr;
+  sources_.emplace_back(source);
+
+  struct epoll_event ev = {};
+  ev.events = events;
+  ev.data.ptr = source;
+  int ret = epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+  assert(ret == 0);
+  return source;
+}
+
+EventLoop::Source* EventLoop::add_fd(int fd,
+                                     uint32_t events,
+                                     FdCallback callback,
+                                     void* data) {
+  Source* source = add_source(kFd, fd, events);
+  source->fd_callback = callback;
+  source->data = data;
+  return source;
+}
+
+EventLoop::Source* EventLoop::add_timer(uint64_t delay_ns,
+                                        uint64_t interval_ns,
+                                        Callback callback,
+                                        void* data) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  assert(fd >= 0);
+  Source* source = add_source(kTimer, fd, EPOLLIN);
+  source->callback = callback;
+  source->data = data;
+  set_timer(source, delay_ns, interval_ns);
+  return source;
+}
+
+void EventLoop::set_timer(Source* timer,
+                          uint64_t delay_ns,
+                          uint64_t interval_ns) {
+  assert(timer->type == kTimer);
+  struct itimerspec spec;
+  spec.it_interval = to_timespec(interval_ns);
+  // A zero value would disarm the timer.
+  spec.it_value = to_timespec(std::max<uint64_t>(delay_ns, 1));
+  timerfd_settime(timer->fd, 0, &spec, NULL);
+}
+
+EventLoop::Source* EventLoop::add_event(Callback callback, void* data) {
+  int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  assert(fd >= 0);
+  Source* source = add_source(kEvent, fd, EPOLLIN);
+  source->callback = callback;
+  source->data = data;
+  return source;
+}
+
+void EventLoop::signal(Source* event) {
+  assert(event->type == kEvent);
+  uint64_t one = 1;
+  ssize_t ret = write(event->fd, &one, sizeof(one));
+  (void)ret;
+}
+
+void EventLoop::remove(Source* source) {
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, source->fd, NULL);
+  if (source->type != kFd)
+    close(source->fd);
+  for (size_t i = 0; i < sources_.size(); i++) {
+    if (sources_[i].get() == source) {
+      sources_.erase(sources_.begin() + i);
+      break;
+    }
+  }
+}
+
+void EventLoop::quit() {
+  quit_.store(true);
+  uint64_t one = 1;
+  ssize_t ret = write(wake_fd_, &one, sizeof(one));
+  (void)ret;
+}
+
+// Called with the display prepared for reading.
+bool EventLoop::dispatch_display(bool readable) {
+  if (readable) {
+    if (wl_display_read_events(display_) == -1)
+      return false;
+  } else {
+    wl_display_cancel_read(display_);
+  }
+  if (wl_display_dispatch_pending(display_) == -1)
+    return false;
+  if (dispatch_callback_)
+    dispatch_callback_(dispatch_data_);
+  return true;
+}
+
+bool EventLoop::run() {
+  struct epoll_event events[kMaxEvents];
+
+  while (!quit_.load()) {
+    if (display_) {
+      // Events another thread already read have to be dispatched before
+      // this thread may wait for more.
+      while (wl_display_prepare_read(display_) != 0) {
+        if (wl_display_dispatch_pending(display_) == -1)
+          return false;
+      }
+      // That only checks the default queue. Nothing more is read into the
+      // others while this thread is prepared to read.
+      if (dispatch_callback_)
+        dispatch_callback_(dispatch_data_);
+      // If the socket is full, the rest goes with the next flush.
+      if (wl_display_flush(display_) == -1 && errno != EAGAIN) {
+        wl_display_cancel_read(display_);
+        return false;
+      }
+    }
+
+    int count = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (count < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      if (display_)
+        wl_display_cancel_read(display_);
+      return false;
+    }
+
+    bool display_readable = false;
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.ptr == this)
+        display_readable = true;
+    }
+    if (display_) {
+      TRACE_SCOPE("dispatch");
+      if (!dispatch_display(display_readable))
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+      void* ptr = events[i].data.ptr;
+      if (ptr == this)
+        continue;
+      if (!ptr) {
+        uint64_t value;
+        ssize_t ret = read(wake_fd_, &value, sizeof(value));
+        (void)ret;
+        continue;
+      }
+
+      // A callback may have removed a source that is ready later in this
+      // batch.
+      Source* source = static_cast<Source*>(ptr);
+      bool live = false;
+      for (const std::unique_ptr<Source>& s : sources_)
+        live = live || s.get() == source;
+      if (!live)
+        continue;
+
+      TRACE_SCOPE("source");
+      if (source->type == kFd) {
+        source->fd_callback(source->data, events[i].events);
+      } else {
+        // The number of expirations, or of signal() calls.
+        uint64_t value;
+        if (read(source->fd, &value, sizeof(value)) == sizeof(value))
+          source->callback(source->data);
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef OPENGL_WAYLAND_EVENT_LOOP_H_
+#define OPENGL_WAYLAND_EVENT_LOOP_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+struct wl_display;
+
+// Waits on any number of file descriptors with epoll and calls back when
+// they are ready, on the thread that runs it.
+//
+// The Wayland connection is one of them. It is read with
+// wl_display_prepare_read() and wl_display_read_events(), so other threads
+// can dispatch their own event queues on the same connection, as EGL does
+// while swapping. Timers are timerfds, and events that other threads
+// signal are eventfds, so nothing busy-waits.
+class EventLoop {
+ public:
+  typedef void (*FdCallback)(void* data, uint32_t events);
+  typedef void (*Callback)(void* data);
+
+  class Source;
+
+  EventLoop();
+  ~EventLoop();
+
+  void init();
+
+  // Dispatches |display| whenever it has events.
+  void set_display(struct wl_display* display);
+  // Calls |callback| each time the display was read and before waiting
+  // for it, after its default queue is dispatched, to dispatch the other
+  // queues this thread owns.
+  void set_dispatch_callback(Callback callback, void* data);
+
+  // Calls |callback| with the epoll events whenever |fd| has one of
+  // |events|. The fd stays owned by the caller.
+  Source* add_fd(int fd, uint32_t events, FdCallback callback, void* data);
+  // Calls |callback| after |delay_ns|, then every |interval_ns| unless it
+  // is 0. Expirations missed while busy are folded into one call.
+  Source* add_timer(uint64_t delay_ns,
+                    uint64_t interval_ns,
+                    Callback callback,
+                    void* data);
+  void set_timer(Source* timer, uint64_t delay_ns, uint64_t interval_ns);
+  // Calls |callback| after signal() was called on the source, once however
+  // many times that was.
+  Source* add_event(Callback callback, void* data);
+  // May be called from any thread, and from signal handlers.
+  void signal(Source* event);
+  void remove(Source* source);
+
+  // Runs until quit(), or until the display connection fails. Returns
+  // false in that case. Returns at once if quit() was called before.
+  bool run();
+  // May be called from any thread, and from signal handlers.
+  void quit();
+
+ private:
+  enum SourceType { kFd, kTimer, kEvent };
+
+  bool dispatch_display(bool readable);
+  Source* add_source(SourceType type, int fd, uint32_t events);
+
+  int epoll_fd_;
+  // Wakes run() for quit().
+  int wake_fd_;
+  std::atomic<bool> quit_;
+  struct wl_display* display_;
+  Callback dispatch_callback_;
+  void* dispatch_data_;
+  std::vector<std::unique_ptr<Source>> sources_;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#include "frame_clock.h"
+
+FrameClock::FrameClock() : step_(0), now_(0), frames_(0) {}
+
+void FrameClock::set_step(double seconds) {
+  step_ = seconds;
+}
+
+void FrameClock::tick() {
+  if (step_ > 0) {
+    now_ = frames_ * step_;
+  } else {
+    std::chrono::steady_clock::time_point time =
+        std::chrono::steady_clock::now();
+    if (frames_ == 0)
+      start_ = time;
+    now_ = std::chrono::duration<double>(time - start_).count();
+  }
+  frames_++;
+}
@@ -0,0 +1,35 @@
+#ifndef OPENGL_WAYLAND_FRAME_CLOCK_H_
+#define OPENGL_WAYLAND_FRAME_CLOCK_H_
+
+#include <chrono>
+
+// The time a window's frames are animated at.
+//
+// By default it is the real time since the first frame. With a fixed step,
+// frame n is at n * step seconds however long it took to draw, so every
+// run animates through the same frames, as a benchmark needs.
+//
+// tick() moves it to the next frame before the scene is updated: in the
+// update when there is one, else before drawPtr. With an update running on
+// the pool, drawPtr sees the time of the update in flight.
+class FrameClock {
+ public:
+  FrameClock();
+
+  // A step of 0 goes back to real time.
+  void set_step(double seconds);
+  void tick();
+
+  // In seconds.
+  double now() const { return now_; }
+  // Frames ticked so far, counting the current one.
+  unsigned frames() const { return frames_; }
+
+ private:
+  double step_;
+  std::chrono::steady_clock::time_point start_;
+  double now_;
+  unsigned frames_;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "frame_scheduler.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "presentation-time-client-protocol.h"
+
+namespace {
+
+const int64_t kNanosecondsPerSecond = 1000000000;
+const int64_t kNanosecondsPerMillisecond = 1000000;
+
+// The margin starts here and never goes below the minimum. The compositor
+// needs some of it to composite before the vblank.
+const int64_t kInitialMargin = 4 * kNanosecondsPerMillisecond;
+const int64_t kMinMargin = 1 * kNanosecondsPerMillisecond;
+const int64_t kMarginStep = kNanosecondsPerMillisecond / 4;
+// Frames in a row on time before the margin shrinks by a step.
+const unsigned kOnTimeToShrink = 120;
+
+}  // namespace
+
+const struct wp_presentation_feedback_listener
+    FrameScheduler::feedback_listener_ = {
+        FrameScheduler::handle_sync_output,
+        FrameScheduler::handle_presented,
+        FrameScheduler::handle_discarded,
+};
+
+FrameScheduler::FrameScheduler()
+    : presentation_(nullptr),
+      clock_(CLOCK_MONOTONIC),
+      next_frame_(0),
+      next_cost_(0),
+      frame_start_(0),
+      frame_target_(0),
+      swap_start_(0),
+      first_frame_(0),
+      last_frame_(0),
+      swap_total_(0),
+      drawn_(0),
+      last_presented_(0),
+      refresh_(0),
+      margin_(kInitialMargin),
+      on_time_(0),
+      presented_(0),
+      missed_(0),
+      discarded_(0),
+      latency_total_(0) {
+  for (int i = 0; i < kMaxFramesInFlight; i++) {
+    frames_[i].scheduler = this;
+    frames_[i].feedback = nullptr;
+  }
+  std::fill(costs_, costs_ + kCostHistory, 0);
+}
+
+void FrameScheduler::init(struct wp_presentation* presentation,
+                          clockid_t clock) {
+  presentation_ = presentation;
+  clock_ = clock;
+}
+
+void FrameScheduler::destroy() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int i = 0; i < kMaxFramesInFlight; i++)
+    release(&frames_[i]);
+}
+
+int64_t FrameScheduler::now() const {
+  struct timespec ts;
+  clock_gettime(clock_, &ts);
+  return ts.tv_sec * kNanosecondsPerSecond + ts.tv_nsec;
+}
+
+void FrameScheduler::wait_for_deadline() {
+  if (!presentation_)
+    return;
+
+  int64_t start;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_target_ = 0;
+    if (!last_presented_ || !refresh_)
+      return;
+
+    int64_t lead = *std::max_element(costs_, costs_ + kCostHistory) + margin_;
+    int64_t earliest = now() + lead;
+    // The first vblank the frame can still make.
+    int64_t vblanks = (earliest - last_presented_ + refresh_ - 1) / refresh_;
+    frame_target_ = last_presented_ + std::max<int64_t>(vblanks, 1) * refresh_;
+    start = frame_target_ - lead;
+  }
+
+  struct timespec ts;
+  ts.tv_sec = start / kNanosecondsPerSecond;
+  ts.tv_nsec = start % kNanosecondsPerSecond;
+  while (clock_nanosleep(clock_, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+void FrameScheduler::begin_frame() {
+  frame_start_ = now();
+}
+
+void FrameScheduler::end_frame(struct wl_surface* surface) {
+  int64_t end = now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  costs_[next_cost_] = end - frame_start_;
+  next_cost_ = (next_cost_ + 1) % kCostHistory;
+  swap_start_ = end;
+  int64_t target = frame_target_;
+  frame_target_ = 0;
+
+  if (!presentation_)
+    return;
+  // If the compositor is that far behind, this frame goes without.
+  Frame* frame = &frames_[next_frame_];
+  if (frame->feedback)
+    return;
+  next_frame_ = (next_frame_ + 1) % kMaxFramesInFlight;
+
+  frame->start = frame_start_;
+  frame->target = target;
+  frame->feedback = wp_presentation_feedback(presentation_, surface);
+  wp_presentation_feedback_add_listener(frame->feedback, &feedback_listener_,
+                                        frame);
+}
+
+void FrameScheduler::end_swap() {
+  int64_t end = now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  swap_total_ += end - swap_start_;
+  if (!drawn_)
+    first_frame_ = end;
+  last_frame_ = end;
+  drawn_++;
+}
+
+void FrameScheduler::release(Frame* frame) {
+  if (frame->feedback)
+    wp_presentation_feedback_destroy(frame->feedback);
+  frame->feedback = nullptr;
+}
+
+void FrameScheduler::handle_sync_output(
+    void* data,
+    struct wp_presentation_feedback* feedback,
+    struct wl_output* output) {}
+
+void FrameScheduler::handle_presented(void* data,
+                                      struct wp_presentation_feedback* feedback,
+                                      uint32_t tv_sec_hi,
+                                      uint32_t tv_sec_lo,
+                                      uint32_t tv_nsec,
+                                      uint32_t refresh,
+                                      uint32_t seq_hi,
+                                      uint32_t seq_lo,
+                                      uint32_t flags) {
+  Frame* frame = static_cast<Frame*>(data);
+  FrameScheduler* self = frame->scheduler;
+  int64_t seconds = (static_cast<int64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+  int64_t time = seconds * kNanosecondsPerSecond + tv_nsec;
+
+  std::lock_guard<std::mutex> lock(self->mutex_);
+  self->presented_++;
+  self->latency_total_ += time - frame->start;
+  self->last_presented_ = time;
+  // 0 means the output has no constant refresh rate; keep the last one.
+  if (refresh)
+    self->refresh_ = refresh;
+
+  if (frame->target && time > frame->target + self->refresh_ / 2) {
+    self->missed_++;
+    self->on_time_ = 0;
+    self->margin_ = std::min(self->margin_ + 4 * kMarginStep, self->refresh_);
+  } else if (++self->on_time_ >= kOnTimeToShrink) {
+    self->on_time_ = 0;
+    self->margin_ = std::max(self->margin_ - kMarginStep, kMinMargin);
+  }
+  self->release(frame);
+}
+
+void FrameScheduler::handle_discarded(
+    void* data,
+    struct wp_presentation_feedback* feedback) {
+  Frame* frame = static_cast<Frame*>(data);
+  FrameScheduler* self = frame->scheduler;
+
+  std::lock_guard<std::mutex> lock(self->mutex_);
+  self->discarded_++;
+  self->release(frame);
+}
+
+void FrameScheduler::report() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  double ms = kNanosecondsPerMillisecond;
+  double seconds = static_cast<double>(last_frame_ - first_frame_) /
+                   kNanosecondsPerSecond;
+  fprintf(stderr, "frames: %u drawn, %.1f fps, %.2f ms blocked in swap\n",
+          drawn_, drawn_ > 1 && seconds > 0 ? (drawn_ - 1) / seconds : 0.0,
+          drawn_ ? swap_total_ / ms / drawn_ : 0.0);
+  if (!presentation_) {
+    fprintf(stderr, "frames: no wp_presentation, presentation not measured\n");
+    return;
+  }
+  fprintf(stderr,
+          "frames: %u presented, %u missed, %u discarded; refresh %.2f ms, "
+          "%.2f ms from start to screen, margin %.2f ms\n",
+          presented_, missed_, discarded_, refresh_ / ms,
+          presented_ ? latency_total_ / ms / presented_ : 0.0,
+          margin_ / ms);
+}
+
+unsigned FrameScheduler::drawn() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return drawn_;
+}
+
+unsigned FrameScheduler::presented() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return presented_;
+}
+
+unsigned FrameScheduler::missed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return missed_;
+}
+
+unsigned FrameScheduler::discarded() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return discarded_;
+}
+
+int64_t FrameScheduler::refresh() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return refresh_;
+}
@@ -0,0 +1,112 @@
+#ifndef OPENGL_WAYLAND_FRAME_SCHEDULER_H_
+#define OPENGL_WAYLAND_FRAME_SCHEDULER_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <mutex>
+
+struct wl_output;
+struct wl_surface;
+struct wp_presentation;
+struct wp_presentation_feedback;
+struct wp_presentation_feedback_listener;
+
+// Paces a window's frames with wp_presentation feedback.
+//
+// Every frame asks when its commit reached the screen. From the last
+// presentation time and the refresh interval the scheduler predicts the
+// coming vblanks, and wait_for_deadline() holds a frame back until it can
+// just make the next one: the longest recent frame plus a margin before
+// it. Starting late means the frame shows newer input. A frame presented
+// after the vblank it aimed for counts as missed and widens the margin; a
+// long run of frames on time narrows it again.
+//
+// Without wp_presentation, nothing waits and only the frames drawn are
+// counted.
+class FrameScheduler {
+ public:
+  FrameScheduler();
+
+  void init(struct wp_presentation* presentation, clockid_t clock);
+  // Drops the feedback of frames not presented yet.
+  void destroy();
+
+  // Called on the render thread once a frame is due.
+  void wait_for_deadline();
+  // Bracket the work of a frame. end_frame() asks for feedback on the next
+  // commit of |surface|, so it comes before the swap.
+  void begin_frame();
+  void end_frame(struct wl_surface* surface);
+  // Called after eglSwapBuffers returns, to measure how long it blocked.
+  void end_swap();
+
+  // Prints the frame counts and timings to stderr.
+  void report();
+
+  // Frames drawn, whether or not they were shown.
+  unsigned drawn();
+  unsigned presented();
+  unsigned missed();
+  unsigned discarded();
+  // The refresh interval in nanoseconds, or 0 before the first feedback.
+  int64_t refresh();
+
+ private:
+  static const int kMaxFramesInFlight = 8;
+  static const int kCostHistory = 32;
+
+  struct Frame {
+    FrameScheduler* scheduler;
+    struct wp_presentation_feedback* feedback;
+    int64_t start;
+    int64_t target;  // The vblank it aimed for, or 0.
+  };
+
+  static void handle_sync_output(void* data,
+                                 struct wp_presentation_feedback* feedback,
+                                 struct wl_output* output);
+  static void handle_presented(void* data,
+                               struct wp_presentation_feedback* feedback,
+                               uint32_t tv_sec_hi,
+                               uint32_t tv_sec_lo,
+                               uint32_t tv_nsec,
+                               uint32_t refresh,
+                               uint32_t seq_hi,
+                               uint32_t seq_lo,
+                               uint32_t flags);
+  static void handle_discarded(void* data,
+                               struct wp_presentation_feedback* feedback);
+  static const struct wp_presentation_feedback_listener feedback_listener_;
+
+  // In nanoseconds on the presentation clock.
+  int64_t now() const;
+  void release(Frame* frame);
+
+  struct wp_presentation* presentation_;
+  clockid_t clock_;
+
+  // Guards everything below; feedback arrives on the event thread.
+  std::mutex mutex_;
+  Frame frames_[kMaxFramesInFlight];
+  unsigned next_frame_;
+  int64_t costs_[kCostHistory];
+  unsigned next_cost_;
+  int64_t frame_start_;
+  int64_t frame_target_;
+  int64_t swap_start_;
+  int64_t first_frame_;
+  int64_t last_frame_;
+  int64_t swap_total_;
+  unsigned drawn_;
+  int64_t last_presented_;
+  int64_t refresh_;
+  int64_t margin_;
+  unsigned on_time_;
+  unsigned presented_;
+  unsigned missed_;
+  unsigned discarded_;
+  int64_t latency_total_;  // From begin_frame() to presentation.
+};
+
+#endif
@@ -1,10 +1,18 @@
 #include <assert.h>
+#include <string.h>
 #include <iostream>
 
 #include "gl.h"
 #include "window.h"
 #include "wayland_platform.h"    
 
+// Enough for a few frames of dynamic geometry.
+static const GLsizeiptr kStreamBufferSize = 1 << 20;
+
+// Draws and uniform values recorded in one frame.
+static const size_t kMaxQueuedDraws = 4096;
+static const size_t kMaxQueuedUniforms = 8192;
+
 void GL::init_egl(WaylandDisplay* display, int opaque) {
   static const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2,
                                            EGL_NONE};
@@ -29,7 +37,25 @@ void GL::init_egl(WaylandDisplay* display, int opaque) {
   if (opaque)
     config_attribs[9] = 0;
 
-  display->egl.dpy = eglGetDisplay((EGLNativeDisplayType)display->display_);
+  if (display->headless) {
+    // Nothing is shown, so any display that can render will do. Mesa's
+    // surfaceless platform needs neither a GPU nor a window system.
+    config_attribs[1] = EGL_PBUFFER_BIT;
+    const char* client_extensions =
+        eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (client_extensions && get_platform_display &&
+        strstr(client_extensions, "EGL_MESA_platform_surfaceless")) {
+      display->egl.dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, NULL);
+    } else {
+      display->egl.dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+  } else {
+    display->egl.dpy = eglGetDisplay((EGLNativeDisplayType)display->display_);
+  }
   assert(display->egl.dpy);
 
   ret = eglInitialize(display->egl.dpy, &major, &minor);
@@ -44,75 +70,73 @@ void GL::init_egl(WaylandDisplay* display, int opaque) {
   display->egl.ctx = eglCreateContext(display->egl.dpy, display->egl.conf,
                                       EGL_NO_CONTEXT, context_attribs);
   assert(display->egl.ctx);
+
+  program_ = 0;
+  eglDisplay_ = display->egl.dpy;
+  compileContext_ = EGL_NO_CONTEXT;
+  const char* extensions = eglQueryString(display->egl.dpy, EGL_EXTENSIONS);
+  surfaceless_ =
+      extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+  if (surfaceless_) {
+    compileContext_ =
+        eglCreateContext(display->egl.dpy, display->egl.conf,
+                         display->egl.ctx, context_attribs);
+  }
 }
 
 void GL::finish_egl(WaylandDisplay* display) {
+  profiler.destroy();
+  meshes.destroy_all();
+  stream.destroy();
+  shaders.destroy_all();
+  if (compileContext_ != EGL_NO_CONTEXT)
+    eglDestroyContext(display->egl.dpy, compileContext_);
   eglTerminate(display->egl.dpy);
   eglReleaseThread();
 }
 
-static GLuint create_shader(const char* source, GLenum shader_type) {
-  GLuint shader;
-  GLint status;
-
-  shader = glCreateShader(shader_type);
-  assert(shader != 0);
+void GL::init_context(const char* vertShaderText,
+                      const char* fragShaderText) {
+  const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+  gles3_ = version && strncmp(version, "OpenGL ES ", 10) == 0 &&
+           version[10] >= '3';
+  programs.init(gles3_);
+  shaders.init(&programs, eglDisplay_, compileContext_);
 
-  glShaderSource(shader, 1, (const char**)&source, NULL);
-  glCompileShader(shader);
+  pos = 0;
+  col = 1;
 
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-  if (!status) {
-    char log[1000];
-    GLsizei len;
-    glGetShaderInfoLog(shader, 1000, &len, log);
-    fprintf(stderr, "Error: compiling %s: %*s\n",
-            shader_type == GL_VERTEX_SHADER ? "vertex" : "fragment", len, log);
-    exit(1);
-  }
+  // The locations are bound before the program is linked. They used to be
+  // bound afterwards, which took a second link to apply.
+  const AttribBinding bindings[] = {{pos, "pos"}, {col, "color"}};
+  program_ = shaders.create_program_async(vertShaderText, fragShaderText,
+                                          bindings, 2);
+}
 
-  return shader;
+void GL::begin_init_gl(WaylandDisplay* display,
+    const char* vertShaderText, const char* fragShaderText) {
+  if (!surfaceless_)
+    return;
+  EGLBoolean ret = eglMakeCurrent(display->egl.dpy, EGL_NO_SURFACE,
+                                  EGL_NO_SURFACE, display->egl.ctx);
+  assert(ret == EGL_TRUE);
+  init_context(vertShaderText, fragShaderText);
 }
 
 void GL::init_gl(unsigned width, unsigned height,
     const char* vertShaderText, const char* fragShaderText) {
-  GLuint frag, vert;
-  GLint status;
-
   viewportWidth_ = width;
   viewportHeight_ = height;
 
-  frag = create_shader(fragShaderText, GL_FRAGMENT_SHADER);
-  vert = create_shader(vertShaderText, GL_VERTEX_SHADER);
-
-  program = glCreateProgram();
-  glAttachShader(program, frag);
-  glAttachShader(program, vert);
-  glLinkProgram(program);
-
-  glGetProgramiv(program, GL_LINK_STATUS, &status);
-  if (!status) {
-    char log[1000];
-    GLsizei len;
-    glGetProgramInfoLog(program, 1000, &len, log);
-    fprintf(stderr, "Error: linking:\n%*s\n", len, log);
-    exit(1);
-  }
-
-  glUseProgram(program);
-
-  pos = 0;
-  col = 1;
-
-  // VertexBufferObject IDs
-  vertexBuffer[0] = 0;
-  vertexBuffer[1] = 0;
-  vertexBuffer[2] = 0;
-
-  glBindAttribLocation(program, pos, "pos");
-  glBindAttribLocation(program, col, "color");
-  glLinkProgram(program);
+  if (!program_)
+    init_context(vertShaderText, fragShaderText);
+  meshes.init(gles3_);
+  stream.init(GL_ARRAY_BUFFER, kStreamBufferSize, gles3_);
+  queue.init(kMaxQueuedDraws, kMaxQueuedUniforms);
+}
 
-  // Return the location of a uniform variable.
-  rotation_uniform = glGetUniformLocation(program, "rotation");
+void GL::finish_init_gl() {
+  shaders.use(program_);
+  // Setup code made plain GL calls.
+  state.invalidate();
 }
@@ -5,34 +5,64 @@
 #define OPENGL_WAYLAND_GL_H_
 
 #include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 
 #include <vector>
+#include "gpu_profiler.h"
+#include "mesh.h"
+#include "program_cache.h"
+#include "render_queue.h"
+#include "shader_manager.h"
+#include "state_cache.h"
+#include "stream_buffer.h"
 #include "window.h"
 
 class GL {
  public:
   void init_gl(unsigned width, unsigned height, 
       const char* vertShaderText, const char* fragShaderText);
+  // Starts building the program before there is a surface to make the
+  // context current with, if EGL allows a context without one. init_gl()
+  // then keeps going with it.
+  void begin_init_gl(WaylandDisplay* display,
+      const char* vertShaderText, const char* fragShaderText);
+  // Waits for the program and makes it current. Called before the first
+  // frame, so that everything after init_gl() overlaps the compile.
+  void finish_init_gl();
   void init_egl(WaylandDisplay* display, int opaque);
   void finish_egl(WaylandDisplay* display);
   unsigned getViewportWidth() { return viewportWidth_; }
   unsigned getViewportHeight() { return viewportHeight_; }
+  // Whether the context is OpenGL ES 3.0 or later.
+  bool isGLES3() const { return gles3_; }
+  // The program built from the shaders passed to init_gl.
+  ProgramHandle getProgram() const { return program_; }
 
 // private:
-  GLuint program;
-  GLuint rotation_uniform;
   GLuint pos;
   GLuint col;
   GLuint texture_id;  // Texture handle.
-  GLint sampler;      // Sampler location.
-	GLuint vertexBuffer[3];   // Vertex Buffer.
-  GLuint mvpLoc; // Uniform location.
+  ProgramCache programs;  // Linked programs, cached on disk.
+  ShaderManager shaders;  // Programs and their locations.
+  StateCache state;  // Skips state changes that change nothing.
+  MeshManager meshes;  // Vertex and index buffers.
+  StreamBuffer stream; // Vertex data written every frame.
+  RenderQueue queue;  // Draws recorded this frame, replayed after drawPtr.
+  GpuProfiler profiler;  // GPU time of each pass, when enabled.
   ESMatrix mvpMatrix;
 
  private:
   unsigned viewportWidth_;
   unsigned viewportHeight_;
+  void init_context(const char* vertShaderText, const char* fragShaderText);
+
+  bool gles3_;
+  ProgramHandle program_;
+  // Shares objects with the main context, for compiling on another thread.
+  EGLDisplay eglDisplay_;
+  EGLContext compileContext_;
+  bool surfaceless_;
 
 };
 
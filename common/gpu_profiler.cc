@@ -0,0 +1,264 @@
+#include "gpu_profiler.h"
+
+#include <EGL/egl.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+
+// Pass 0 is the time outside any pass.
+static const char kOtherPass[] = "other";
+
+GpuProfiler::GpuProfiler()
+    : enabled_(false),
+      log_(false),
+      callback_(nullptr),
+      callback_data_(nullptr),
+      next_frame_(0),
+      current_(nullptr),
+      depth_(0),
+      segment_open_(false),
+      pass_count_(0),
+      frame_(0),
+      dropped_(0),
+      log_frames_(0),
+      log_total_(0),
+      gen_queries_(nullptr),
+      delete_queries_(nullptr),
+      begin_query_(nullptr),
+      end_query_(nullptr),
+      get_query_uiv_(nullptr),
+      get_query_ui64v_(nullptr) {
+  memset(queries_, 0, sizeof(queries_));
+  memset(frames_, 0, sizeof(frames_));
+}
+
+void GpuProfiler::init(bool log) {
+  const char* extensions =
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  if (extensions && strstr(extensions, "GL_EXT_disjoint_timer_query")) {
+    gen_queries_ = reinterpret_cast<PFNGLGENQUERIESEXTPROC>(
+        eglGetProcAddress("glGenQueriesEXT"));
+    delete_queries_ = reinterpret_cast<PFNGLDELETEQUERIESEXTPROC>(
+        eglGetProcAddress("glDeleteQueriesEXT"));
+    begin_query_ = reinterpret_cast<PFNGLBEGINQUERYEXTPROC>(
+        eglGetProcAddress("glBeginQueryEXT"));
+    end_query_ = reinterpret_cast<PFNGLENDQUERYEXTPROC>(
+        eglGetProcAddress("glEndQueryEXT"));
+    get_query_uiv_ = reinterpret_cast<PFNGLGETQUERYOBJECTUIVEXTPROC>(
+        eglGetProcAddress("glGetQueryObjectuivEXT"));
+    get_query_ui64v_ = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(
+        eglGetProcAddress("glGetQueryObjectui64vEXT"));
+  }
+  enabled_ = gen_queries_ && delete_queries_ && begin_query_ && end_query_ &&
+             get_query_uiv_ && get_query_ui64v_;
+  if (!enabled_) {
+    if (log)
+      LOG_WARNING("gpu: no EXT_disjoint_timer_query, not measured");
+    return;
+  }
+
+  log_ = log;
+  gen_queries_(kFramesInFlight * kMaxQueries, &queries_[0][0]);
+  passes_[0].name = kOtherPass;
+  passes_[0].total = 0;
+  pass_count_ = 1;
+  // Clears any disjoint event from before the first frame.
+  GLint disjoint;
+  glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+}
+
+void GpuProfiler::destroy() {
+  if (!enabled_)
+    return;
+  delete_queries_(kFramesInFlight * kMaxQueries, &queries_[0][0]);
+  memset(queries_, 0, sizeof(queries_));
+  memset(frames_, 0, sizeof(frames_));
+  current_ = nullptr;
+  enabled_ = false;
+}
+
+void GpuProfiler::set_frame_callback(FrameCallback callback, void* data) {
+  callback_ = callback;
+  callback_data_ = data;
+}
+
+int64_t GpuProfiler::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void GpuProfiler::begin_frame() {
+  if (!enabled_)
+    return;
+  frame_++;
+  collect(false);
+
+  Frame& frame = frames_[next_frame_];
+  if (frame.pending) {
+    dropped_++;
+    return;
+  }
+  frame.number = frame_;
+  frame.start = now();
+  frame.count = 0;
+  frame.complete = true;
+  current_ = &frame;
+  depth_ = 0;
+  begin_pass(kOtherPass);
+}
+
+void GpuProfiler::end_frame() {
+  if (!current_)
+    return;
+  end_pass();
+  assert(depth_ == 0);
+  current_->pending = true;
+  current_ = nullptr;
+  next_frame_ = (next_frame_ + 1) % kFramesInFlight;
+}
+
+void GpuProfiler::begin_pass(const char* name) {
+  if (!current_)
+    return;
+  if (depth_ >= kMaxDepth) {
+    depth_++;
+    return;
+  }
+  if (depth_ > 0)
+    end_segment();
+  int pass = find_pass(name);
+  stack_[depth_++] = pass;
+  begin_segment(pass);
+}
+
+void GpuProfiler::end_pass() {
+  if (!current_)
+    return;
+  assert(depth_ > 0);
+  if (depth_-- > kMaxDepth)
+    return;
+  end_segment();
+  if (depth_ > 0)
+    begin_segment(stack_[depth_ - 1]);
+}
+
+void GpuProfiler::finish() {
+  if (enabled_)
+    collect(true);
+}
+
+// Passes are looked up by pointer first, since names are literals. Past
+// kMaxPasses, new names count as other.
+int GpuProfiler::find_pass(const char* name) {
+  for (int i = 0; i < pass_count_; i++) {
+    if (passes_[i].name == name)
+      return i;
+  }
+  for (int i = 0; i < pass_count_; i++) {
+    if (strcmp(passes_[i].name, name) == 0)
+      return i;
+  }
+  if (pass_count_ == kMaxPasses)
+    return 0;
+  passes_[pass_count_].name = name;
+  passes_[pass_count_].total = 0;
+  return pass_count_++;
+}
+
+void GpuProfiler::begin_segment(int pass) {
+  Frame* frame = current_;
+  if (frame->count == kMaxQueries) {
+    frame->complete = false;
+    return;
+  }
+  int index = frame->count++;
+  Segment& segment = frame->segments[index];
+  segment.query = queries_[frame - frames_][index];
+  segment.pass = pass;
+  begin_query_(GL_TIME_ELAPSED_EXT, segment.query);
+  segment_open_ = true;
+}
+
+void GpuProfiler::end_segment() {
+  if (!segment_open_)
+    return;
+  end_query_(GL_TIME_ELAPSED_EXT);
+  segment_open_ = false;
+}
+
+// The queries of a frame finish in order, so the last one tells.
+bool GpuProfiler::frame_available(const Frame& frame) {
+  if (frame.count == 0)
+    return true;
+  GLuint available = 0;
+  get_query_uiv_(frame.segments[frame.count - 1].query,
+                 GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+  return available;
+}
+
+// Reads back the frames that are done, oldest first.
+void GpuProfiler::collect(bool wait) {
+  GLint disjoint = 0;
+  glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+  for (int i = 0; i < kFramesInFlight; i++) {
+    Frame& frame = frames_[(next_frame_ + i) % kFramesInFlight];
+    if (!frame.pending)
+      continue;
+    if (disjoint || !frame.complete) {
+      frame.pending = false;
+      dropped_++;
+      continue;
+    }
+    if (!wait && !frame_available(frame))
+      break;
+    read_frame(frame);
+    frame.pending = false;
+  }
+}
+
+void GpuProfiler::read_frame(const Frame& frame) {
+  double pass_ms[kMaxPasses] = {};
+  int64_t total = 0;
+  for (int i = 0; i < frame.count; i++) {
+    GLuint64 elapsed = 0;
+    get_query_ui64v_(frame.segments[i].query, GL_QUERY_RESULT_EXT, &elapsed);
+    pass_ms[frame.segments[i].pass] += elapsed / 1e6;
+    total += elapsed;
+  }
+  if (total > now() - frame.start) {
+    dropped_++;
+    return;
+  }
+
+  for (int i = 0; i < pass_count_; i++)
+    passes_[i].total += pass_ms[i];
+  log_total_ += total / 1e6;
+  log_frames_++;
+  if (callback_)
+    callback_(callback_data_, frame.number, total / 1e6);
+  if (log_ && log_frames_ == kLogFrames)
+    log_passes();
+}
+
+// Prints something like
+//   gpu: 1.250 ms a frame: other 0.050, draw 1.000, replay 0.200
+void GpuProfiler::log_passes() {
+  char line[200] = "";
+  size_t length = 0;
+  for (int i = 0; i < pass_count_; i++) {
+    if (length < sizeof(line)) {
+      length += snprintf(line + length, sizeof(line) - length, "%s %s %.3f",
+                         i ? "," : "", passes_[i].name,
+                         passes_[i].total / log_frames_);
+    }
+    passes_[i].total = 0;
+  }
+  LOG_INFO("gpu: %.3f ms a frame:%s (%u dropped)", log_total_ / log_frames_,
+           line, dropped_);
+  log_total_ = 0;
+  log_frames_ = 0;
+}
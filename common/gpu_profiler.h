@@ -0,0 +1,138 @@
+#ifndef OPENGL_WAYLAND_GPU_PROFILER_H_
+#define OPENGL_WAYLAND_GPU_PROFILER_H_
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stdint.h>
+
+// Measures how long the GPU spends on each pass of a frame, with
+// EXT_disjoint_timer_query.
+//
+// A pass is a named part of the frame, bracketed by begin_pass() and
+// end_pass() or by a GpuPass. Everything between begin_frame() and
+// end_frame() outside any pass counts as "other". GL_TIME_ELAPSED_EXT
+// queries cannot nest, so a pass begun inside another ends the outer
+// pass's query and starts it again once the inner one ends; each pass
+// gets its own time, without that of the passes inside it.
+//
+// The queries of each frame come from a ring and are read back several
+// frames later, without waiting for the GPU. If the ring is still busy, a
+// frame goes unmeasured instead. A disjoint event, such as a GPU reset or
+// a change of clock, makes every result in flight meaningless, so those
+// frames are dropped. So are frames that took the GPU longer than the
+// time since they began, which some drivers report for their first query.
+//
+// All calls are made on the thread the context is current on.
+class GpuProfiler {
+ public:
+  // Called with each frame's GPU time, the sum of its passes. Frames are
+  // numbered from 1, in the order they were begun.
+  typedef void (*FrameCallback)(void* data, unsigned frame,
+                                double milliseconds);
+
+  GpuProfiler();
+
+  // With |log| set, prints the average time of each pass to stderr every
+  // few seconds' worth of frames. Does nothing without the extension.
+  void init(bool log);
+  void destroy();
+  bool enabled() const { return enabled_; }
+  void set_frame_callback(FrameCallback callback, void* data);
+
+  void begin_frame();
+  void end_frame();
+  // |name| is kept, so it should be a string literal.
+  void begin_pass(const char* name);
+  void end_pass();
+
+  // Waits for the frames still in flight and reports them.
+  void finish();
+
+  // Frames begun so far.
+  unsigned frame() const { return frame_; }
+  // Frames whose results were thrown away or never taken.
+  unsigned dropped() const { return dropped_; }
+
+ private:
+  static const int kFramesInFlight = 4;
+  // Queries in one frame. A pass split by the passes inside it takes one
+  // per part.
+  static const int kMaxQueries = 32;
+  static const int kMaxPasses = 16;
+  static const int kMaxDepth = 8;
+  static const unsigned kLogFrames = 300;
+
+  struct Segment {
+    GLuint query;
+    int pass;
+  };
+
+  struct Frame {
+    unsigned number;
+    int64_t start;
+    Segment segments[kMaxQueries];
+    int count;
+    bool complete;  // Every part of every pass got a query.
+    bool pending;
+  };
+
+  struct Pass {
+    const char* name;
+    double total;  // In milliseconds, since the last log.
+  };
+
+  // In nanoseconds.
+  static int64_t now();
+  int find_pass(const char* name);
+  void begin_segment(int pass);
+  void end_segment();
+  void collect(bool wait);
+  bool frame_available(const Frame& frame);
+  void read_frame(const Frame& frame);
+  void log_passes();
+
+  bool enabled_;
+  bool log_;
+  FrameCallback callback_;
+  void* callback_data_;
+
+  GLuint queries_[kFramesInFlight][kMaxQueries];
+  Frame frames_[kFramesInFlight];
+  unsigned next_frame_;
+  // The frame being recorded, or NULL if it is not measured.
+  Frame* current_;
+  int stack_[kMaxDepth];
+  int depth_;
+  bool segment_open_;
+
+  Pass passes_[kMaxPasses];
+  int pass_count_;
+  unsigned frame_;
+  unsigned dropped_;
+  unsigned log_frames_;
+  double log_total_;
+
+  PFNGLGENQUERIESEXTPROC gen_queries_;
+  PFNGLDELETEQUERIESEXTPROC delete_queries_;
+  PFNGLBEGINQUERYEXTPROC begin_query_;
+  PFNGLENDQUERYEXTPROC end_query_;
+  PFNGLGETQUERYOBJECTUIVEXTPROC get_query_uiv_;
+  PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64v_;
+};
+
+// Times the rest of the enclosing block as a pass.
+class GpuPass {
+ public:
+  GpuPass(GpuProfiler* profiler, const char* name) : profiler_(profiler) {
+    profiler_->begin_pass(name);
+  }
+  ~GpuPass() { profiler_->end_pass(); }
+
+  GpuPass(const GpuPass&) = delete;
+  void operator=(const GpuPass&) = delete;
+
+ private:
+  GpuProfiler* profiler_;
+};
+
+#endif
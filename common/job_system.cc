@@ -0,0 +1,337 @@
+#include "job_system.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+
+#include "log.h"
+#include "trace.h"
+
+namespace {
+
+// The state of the calling thread, and the pool it belongs to.
+thread_local JobSystem* current_system = nullptr;
+thread_local void* current_state = nullptr;
+
+// Gives the calling thread's state back to its pool when the thread exits.
+struct ThreadSlot {
+  ThreadSlot() : owned(nullptr) {}
+  ~ThreadSlot() {
+    if (owned)
+      owned->store(false, std::memory_order_release);
+  }
+  std::atomic<bool>* owned;
+};
+thread_local ThreadSlot thread_slot;
+
+// Spins this many times looking for work before a worker sleeps.
+const int kIdleSpins = 64;
+
+uint32_t xorshift(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+}  // namespace
+
+JobSystem::Deque::Deque() : top_(0), bottom_(0) {
+  for (int i = 0; i < kMaxJobs; i++)
+    jobs_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+bool JobSystem::Deque::push(Job* job) {
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_acquire);
+  if (b - t >= kMaxJobs)
+    return false;
+  jobs_[b & (kMaxJobs - 1)].store(job, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+  return true;
+}
+
+JobSystem::Job* JobSystem::Deque::pop() {
+  int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Job* job = jobs_[b & (kMaxJobs - 1)].load(std::memory_order_relaxed);
+  if (t == b) {
+    // The last job; a thief may be taking it too.
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      job = nullptr;
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+JobSystem::Job* JobSystem::Deque::steal() {
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom_.load(std::memory_order_acquire);
+  if (t >= b)
+    return nullptr;
+
+  Job* job = jobs_[t & (kMaxJobs - 1)].load(std::memory_order_relaxed);
+  if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed))
+    return nullptr;
+  return job;
+}
+
+bool JobSystem::Deque::empty() const {
+  return top_.load(std::memory_order_acquire) >=
+         bottom_.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem()
+    : thread_count_(0), initialized_(false), sleeping_(0), quit_(false) {
+  for (int i = 0; i < kMaxThreads; i++)
+    threads_[i].store(nullptr, std::memory_order_relaxed);
+}
+
+JobSystem::~JobSystem() {
+  shutdown();
+  // The states go with the pool, so this thread has none left to give back.
+  if (current_system == this) {
+    current_system = nullptr;
+    current_state = nullptr;
+    thread_slot.owned = nullptr;
+  }
+  for (int i = 0; i < kMaxThreads; i++)
+    delete threads_[i].load();
+}
+
+void JobSystem::init(unsigned workers, bool pin) {
+  assert(!initialized_);
+  unsigned cores = std::thread::hardware_concurrency();
+  if (!workers)
+    workers = cores > 1 ? cores - 1 : 1;
+  // Leaves states for the threads that start jobs.
+  workers = std::min<unsigned>(workers, kMaxThreads - 1);
+
+  // Workers get the first states, before any other thread claims one.
+  assert(thread_count_.load() == 0);
+  for (unsigned i = 0; i < workers; i++) {
+    ThreadState* state = new ThreadState();
+    state->random = 2654435761u * (i + 1);
+    threads_[i].store(state);
+  }
+  thread_count_.store(workers);
+
+  initialized_ = true;
+  quit_ = false;
+  for (unsigned i = 0; i < workers; i++) {
+    unsigned core = pin && cores ? (i + 1) % cores : ~0u;
+    workers_.emplace_back(&JobSystem::worker_main, this, threads_[i].load(),
+                          core);
+  }
+}
+
+void JobSystem::shutdown() {
+  if (workers_.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    quit_ = true;
+  }
+  sleep_cond_.notify_all();
+  for (std::thread& worker : workers_)
+    worker.join();
+  workers_.clear();
+}
+
+JobSystem::ThreadState* JobSystem::current_thread() {
+  if (current_system == this)
+    return static_cast<ThreadState*>(current_state);
+
+  // The state of a thread that exited, which may still have jobs queued
+  // for others to steal, or a new one.
+  ThreadState* state = nullptr;
+  unsigned count = thread_count_.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < count && !state; i++) {
+    ThreadState* free_state = threads_[i].load();
+    bool owned = false;
+    if (free_state &&
+        free_state->owned.compare_exchange_strong(owned, true,
+                                                  std::memory_order_acquire))
+      state = free_state;
+  }
+  while (!state && count < kMaxThreads) {
+    if (thread_count_.compare_exchange_weak(count, count + 1)) {
+      state = new ThreadState();
+      state->random = 2654435761u * (count + 1);
+      threads_[count].store(state);
+    }
+  }
+  if (!state) {
+    LOG_WARNING("More than %d threads use the job system, running jobs "
+                "on the calling thread",
+                kMaxThreads);
+    return nullptr;
+  }
+
+  current_system = this;
+  current_state = state;
+  thread_slot.owned = &state->owned;
+  return state;
+}
+
+JobSystem::Job* JobSystem::next_job(ThreadState* self) {
+  Job* job = &self->jobs[self->next_job];
+  // Jobs can run out of order, so this one may be waiting still although
+  // the deque has room.
+  if (job->queued.load(std::memory_order_acquire))
+    return nullptr;
+  self->next_job = (self->next_job + 1) % kMaxJobs;
+  return job;
+}
+
+void JobSystem::run(JobFunction fn, void* data, size_t begin, size_t end,
+                    JobCounter* counter) {
+  if (counter)
+    counter->pending_.fetch_add(1, std::memory_order_relaxed);
+  ThreadState* self = initialized_ ? current_thread() : nullptr;
+  // Without a state, or with the ring or the deque full, the job runs
+  // here and now.
+  Job inline_job;
+  Job* job = self ? next_job(self) : nullptr;
+  if (!job)
+    job = &inline_job;
+  job->function = fn;
+  job->data = data;
+  job->begin = begin;
+  job->end = end;
+  job->counter = counter;
+  job->queued.store(true, std::memory_order_relaxed);
+
+  if (job == &inline_job || !self->deque.push(job)) {
+    execute(job);
+    return;
+  }
+  // Pairs with the fence in worker_main(): either the worker sees the job,
+  // or this sees the worker going to sleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    sleep_cond_.notify_one();
+  }
+}
+
+void JobSystem::execute(Job* job) {
+  JobFunction function = job->function;
+  void* data = job->data;
+  size_t begin = job->begin;
+  size_t end = job->end;
+  JobCounter* counter = job->counter;
+  // The slot may be reused from here on.
+  job->queued.store(false, std::memory_order_release);
+  function(data, begin, end);
+  if (counter)
+    counter->pending_.fetch_sub(1, std::memory_order_release);
+}
+
+JobSystem::Job* JobSystem::find_job(ThreadState* self) {
+  Job* job = self ? self->deque.pop() : nullptr;
+  if (job)
+    return job;
+
+  unsigned count = thread_count_.load(std::memory_order_acquire);
+  if (!count)
+    return nullptr;
+  unsigned start = self ? xorshift(&self->random) % count : 0;
+  for (unsigned i = 0; i < count; i++) {
+    ThreadState* victim = threads_[(start + i) % count].load();
+    if (!victim || victim == self)
+      continue;
+    job = victim->deque.steal();
+    if (job)
+      return job;
+  }
+  return nullptr;
+}
+
+bool JobSystem::has_jobs() const {
+  unsigned count = thread_count_.load(std::memory_order_acquire);
+  for (unsigned i = 0; i < count; i++) {
+    ThreadState* state = threads_[i].load();
+    if (state && !state->deque.empty())
+      return true;
+  }
+  return false;
+}
+
+void JobSystem::wait(JobCounter* counter) {
+  ThreadState* self = current_thread();
+  while (!counter->done()) {
+    Job* job = find_job(self);
+    if (job)
+      execute(job);
+    else
+      std::this_thread::yield();
+  }
+}
+
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain,
+                             JobFunction fn, void* data) {
+  assert(grain > 0);
+  if (end - begin <= grain) {
+    fn(data, begin, end);
+    return;
+  }
+
+  JobCounter counter;
+  // The calling thread takes the first piece itself.
+  for (size_t b = begin + grain; b < end; b += grain)
+    run(fn, data, b, end - b < grain ? end : b + grain, &counter);
+  fn(data, begin, begin + grain);
+  wait(&counter);
+}
+
+void JobSystem::worker_main(ThreadState* self, unsigned core) {
+  TRACE_THREAD_NAME("worker");
+  current_system = this;
+  current_state = self;
+
+  if (core != ~0u) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+
+  int idle = 0;
+  while (!quit_.load(std::memory_order_relaxed)) {
+    Job* job = find_job(self);
+    if (job) {
+      execute(job);
+      idle = 0;
+      continue;
+    }
+    if (++idle < kIdleSpins) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // A job pushed after the check below sees sleeping_ and wakes us.
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleeping_++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!has_jobs() && !quit_)
+      sleep_cond_.wait(lock);
+    sleeping_--;
+    idle = 0;
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef OPENGL_WAYLAND_JOB_SYSTEM_H_
+#define OPENGL_WAYLAND_JOB_SYSTEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs started with it. JobSystem::wait() returns
+// once it drops to zero, which is also how one job waits on others.
+class JobCounter {
+ public:
+  JobCounter() : pending_(0) {}
+  bool done() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+ private:
+  friend class JobSystem;
+  std::atomic<int> pending_;
+};
+
+// A fixed pool of worker threads with one work-stealing deque per thread.
+// A thread pushes and pops jobs at the bottom of its own deque, and idle
+// threads steal from the top of the others', so the jobs a thread spawns
+// mostly stay in its cache.
+//
+// Jobs live in a ring preallocated per thread and are passed by pointer,
+// so nothing is allocated after init(). A thread can have at most
+// kMaxJobs jobs queued at once; run() calls the ones past that straight
+// away.
+//
+// Any thread may start and wait for jobs, including jobs themselves.
+// Waiting runs queued jobs instead of blocking. Without init(), run()
+// calls the job straight away.
+//
+// A thread gets its state on its first job and gives it back when it
+// exits, for the next new thread. Past kMaxThreads at once, a thread runs
+// its jobs straight away too. Threads other than the one destroying the
+// pool have to have exited by then.
+class JobSystem {
+ public:
+  typedef void (*JobFunction)(void* data, size_t begin, size_t end);
+
+  static const int kMaxJobs = 4096;
+  static const int kMaxThreads = 64;
+
+  JobSystem();
+  ~JobSystem();
+
+  // Starts |workers| threads, or one fewer than there are cores if 0, and
+  // at most kMaxThreads - 1. If |pin| is set, worker i only runs on core i + 1, leaving core 0 for the
+  // threads that start the jobs.
+  void init(unsigned workers, bool pin);
+  void shutdown();
+  unsigned worker_count() const { return workers_.size(); }
+
+  // Queues fn(data, begin, end). |counter| may be NULL.
+  void run(JobFunction fn, void* data, size_t begin, size_t end,
+           JobCounter* counter);
+  // Runs jobs until |counter| is zero.
+  void wait(JobCounter* counter);
+
+  // Calls fn(data, b, e) over [begin, end) in pieces of at most |grain|,
+  // spread over the pool, and waits for them.
+  void parallel_for(size_t begin, size_t end, size_t grain, JobFunction fn,
+                    void* data);
+  template <typename F>
+  void parallel_for(size_t begin, size_t end, size_t grain, const F& f) {
+    parallel_for(begin, end, grain, &call<F>,
+                 const_cast<void*>(static_cast<const void*>(&f)));
+  }
+
+ private:
+  struct Job {
+    Job() : queued(false) {}
+    JobFunction function;
+    void* data;
+    size_t begin;
+    size_t end;
+    JobCounter* counter;
+    // Set while the job waits in a deque, so that its slot is not reused.
+    std::atomic<bool> queued;
+  };
+
+  // The Chase-Lev deque, as in "Correct and Efficient Work-Stealing for
+  // Weak Memory Models" (Le et al., 2013), with a fixed size.
+  class Deque {
+   public:
+    Deque();
+    // Only called by the thread owning the deque. Returns false if it is
+    // full.
+    bool push(Job* job);
+    Job* pop();
+    // Called by any other thread.
+    Job* steal();
+    bool empty() const;
+
+   private:
+    std::atomic<int64_t> top_;
+    std::atomic<int64_t> bottom_;
+    std::atomic<Job*> jobs_[kMaxJobs];
+  };
+
+  struct ThreadState {
+    ThreadState() : next_job(0), random(0), owned(true) {}
+    Deque deque;
+    Job jobs[kMaxJobs];
+    unsigned next_job;
+    uint32_t random;  // For picking whom to steal from.
+    // Cleared when the thread that had it exits.
+    std::atomic<bool> owned;
+  };
+
+  template <typename F>
+  static void call(void* data, size_t begin, size_t end) {
+    (*static_cast<const F*>(data))(begin, end);
+  }
+
+  // The calling thread's state, claimed on its first call. NULL if all
+  // kMaxThreads are taken.
+  ThreadState* current_thread();
+  // The next slot of the ring, or NULL if it is still queued.
+  Job* next_job(ThreadState* self);
+  // Pops a job if |self| is not NULL, or steals one.
+  Job* find_job(ThreadState* self);
+  void execute(Job* job);
+  bool has_jobs() const;
+  void worker_main(ThreadState* self, unsigned core);
+
+  std::vector<std::thread> workers_;
+  // States of workers first, then of other threads, in claim order.
+  std::atomic<ThreadState*> threads_[kMaxThreads];
+  std::atomic<unsigned> thread_count_;
+  bool initialized_;
+
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cond_;
+  std::atomic<int> sleeping_;
+  std::atomic<bool> quit_;
+};
+
+#endif
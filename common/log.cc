@@ -0,0 +1,264 @@
+#include "log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <thread>
+
+namespace {
+
+// A power of two, so that positions wrap cleanly.
+const uint64_t kQueueRecords = 256;
+// Longer messages are cut short.
+const size_t kMessageSize = 240;
+const int64_t kRateWindow = 1000000000;  // In nanoseconds.
+
+const char kLevelNames[] = {'D', 'I', 'W', 'E'};
+
+// A slot of the queue. |sequence| says whose turn it is: the producer that
+// claims position p waits for p, and the writer for p + 1.
+struct LogRecord {
+  std::atomic<uint64_t> sequence;
+  int level;
+  uint32_t suppressed;
+  int64_t time;
+  char message[kMessageSize];
+};
+
+// The bounded queue of "Bounded MPMC queue" (Vyukov), with the writer as
+// the only consumer.
+LogRecord queue[kQueueRecords];
+std::atomic<uint64_t> enqueue_pos(0);
+uint64_t dequeue_pos = 0;  // Only the writer uses it.
+
+// Messages lost to a full queue, reported by the writer.
+std::atomic<uint32_t> dropped(0);
+std::atomic<bool> running(false);
+std::atomic<bool> stopping(false);
+// Producers between checking |running| and waking the writer. shutdown()
+// waits for them, so that none publishes after the last drain() or wakes
+// a closed |wake_fd|.
+std::atomic<int> active_writers(0);
+// Set while the writer may be blocked on |wake_fd|. A producer that clears
+// it wakes the writer up.
+std::atomic<bool> writer_sleeping(false);
+int wake_fd = -1;
+std::thread* writer = nullptr;
+
+int64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+const int64_t start_time = now();
+
+// Writes one line, as "[  1.234] W message".
+void print(int level, uint32_t suppressed, int64_t time,
+           const char* message) {
+  char line[kMessageSize + 64];
+  int length = snprintf(line, sizeof(line), "[%8.3f] %c %s",
+                        (time - start_time) / 1e9, kLevelNames[level],
+                        message);
+  if (suppressed && length >= 0 && static_cast<size_t>(length) < sizeof(line))
+    snprintf(line + length, sizeof(line) - length, " (%u suppressed)",
+             suppressed);
+  // One call, so that lines from different threads do not mix.
+  fprintf(stderr, "%s\n", line);
+}
+
+// Returns the slot at the tail of the queue, or NULL if it is full.
+LogRecord* claim(uint64_t* position) {
+  uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  for (;;) {
+    LogRecord* record = &queue[pos % kQueueRecords];
+    uint64_t sequence = record->sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence - pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        *position = pos;
+        return record;
+      }
+    } else if (diff < 0) {
+      // The writer has not taken the record a lap ago yet.
+      return nullptr;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+bool pending() {
+  LogRecord* record = &queue[dequeue_pos % kQueueRecords];
+  return record->sequence.load(std::memory_order_acquire) == dequeue_pos + 1;
+}
+
+// Writes every record published so far.
+void drain() {
+  bool wrote = false;
+  while (pending()) {
+    LogRecord* record = &queue[dequeue_pos % kQueueRecords];
+    print(record->level, record->suppressed, record->time, record->message);
+    record->sequence.store(dequeue_pos + kQueueRecords,
+                           std::memory_order_release);
+    dequeue_pos++;
+    wrote = true;
+  }
+  uint32_t lost = dropped.exchange(0);
+  if (lost) {
+    char message[64];
+    snprintf(message, sizeof(message), "%u messages lost, the queue was full",
+             lost);
+    print(LOG_LEVEL_WARNING, 0, now(), message);
+    wrote = true;
+  }
+  if (wrote)
+    fflush(stderr);
+}
+
+void writer_main() {
+  for (;;) {
+    drain();
+    if (stopping.load())
+      break;
+    // Checks the queue again after saying it is going to sleep, so that a
+    // message published in between is not left waiting.
+    writer_sleeping.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pending() || stopping.load()) {
+      writer_sleeping.store(false);
+      continue;
+    }
+    uint64_t value;
+    ssize_t ret = read(wake_fd, &value, sizeof(value));
+    (void)ret;
+  }
+  drain();
+}
+
+// Writes the message on the calling thread.
+void print_now(int level, uint32_t suppressed, const char* format,
+               va_list args) {
+  char message[kMessageSize];
+  vsnprintf(message, sizeof(message), format, args);
+  print(level, suppressed, now(), message);
+}
+
+void wake_writer() {
+  uint64_t one = 1;
+  ssize_t ret = write(wake_fd, &one, sizeof(one));
+  (void)ret;
+}
+
+}  // namespace
+
+std::atomic<int> Log::level_(LOG_LEVEL_INFO);
+
+void Log::init() {
+  const char* level = getenv("OPENGL_WAYLAND_LOG");
+  if (level) {
+    if (strcmp(level, "debug") == 0)
+      level_.store(LOG_LEVEL_DEBUG);
+    else if (strcmp(level, "info") == 0)
+      level_.store(LOG_LEVEL_INFO);
+    else if (strcmp(level, "warning") == 0)
+      level_.store(LOG_LEVEL_WARNING);
+    else if (strcmp(level, "error") == 0)
+      level_.store(LOG_LEVEL_ERROR);
+    else
+      fprintf(stderr, "Unknown OPENGL_WAYLAND_LOG: %s\n", level);
+  }
+
+  if (writer)
+    return;
+  wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (wake_fd < 0) {
+    perror("eventfd");
+    return;
+  }
+  for (uint64_t i = 0; i < kQueueRecords; i++)
+    queue[i].sequence.store(i, std::memory_order_relaxed);
+  stopping.store(false);
+  writer = new std::thread(writer_main);
+  running.store(true);
+}
+
+void Log::shutdown() {
+  if (!writer)
+    return;
+  // From here on producers write straight away. Those that got in before
+  // finish publishing first.
+  running.store(false);
+  while (active_writers.load())
+    std::this_thread::yield();
+  stopping.store(true);
+  wake_writer();
+  writer->join();
+  delete writer;
+  writer = nullptr;
+  close(wake_fd);
+  wake_fd = -1;
+}
+
+void Log::write(int level, uint32_t suppressed, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  if (!running.load(std::memory_order_acquire)) {
+    print_now(level, suppressed, format, args);
+    va_end(args);
+    return;
+  }
+  // Checks |running| again once counted, in the same order as shutdown()
+  // does the opposite: either it waits for this, or this sees it stopping.
+  active_writers.fetch_add(1);
+  if (!running.load()) {
+    active_writers.fetch_sub(1);
+    print_now(level, suppressed, format, args);
+    va_end(args);
+    return;
+  }
+
+  uint64_t position;
+  LogRecord* record = claim(&position);
+  if (!record) {
+    va_end(args);
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    active_writers.fetch_sub(1, std::memory_order_release);
+    return;
+  }
+  record->level = level;
+  record->suppressed = suppressed;
+  record->time = now();
+  vsnprintf(record->message, kMessageSize, format, args);
+  va_end(args);
+  record->sequence.store(position + 1, std::memory_order_release);
+
+  // Pairs with the fence in writer_main(): either the writer sees the
+  // record, or this sees that it went to sleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writer_sleeping.load(std::memory_order_relaxed) &&
+      writer_sleeping.exchange(false))
+    wake_writer();
+  active_writers.fetch_sub(1, std::memory_order_release);
+}
+
+bool LogRate::allow(uint32_t* suppressed) {
+  int64_t time = now();
+  int64_t start = window_start_.load(std::memory_order_relaxed);
+  if (time - start >= kRateWindow &&
+      window_start_.compare_exchange_strong(start, time,
+                                            std::memory_order_relaxed))
+    count_.store(0, std::memory_order_relaxed);
+  if (count_.fetch_add(1, std::memory_order_relaxed) >= Log::kBurst) {
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  *suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+  return true;
+}
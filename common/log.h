@@ -0,0 +1,103 @@
+#ifndef OPENGL_WAYLAND_LOG_H_
+#define OPENGL_WAYLAND_LOG_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Severity levels. They are plain numbers, so that the preprocessor can
+// compare them with OPENGL_WAYLAND_MIN_LOG_LEVEL.
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+// Logging that never blocks the thread that logs.
+//
+// LOG_DEBUG() and friends format the message on the calling thread into a
+// fixed-size record and push it onto a bounded lock-free queue. A writer
+// thread takes the records off and writes them to stderr. If the queue is
+// full, the message is dropped and counted rather than waited for. Before
+// init() and after shutdown() messages are written straight away.
+//
+// Each call site may log kBurst messages a second. The ones past that are
+// counted, and the count goes with the site's next message.
+//
+// OPENGL_WAYLAND_LOG=debug|info|warning|error sets the lowest level that
+// is logged, info by default. Building with
+// -DOPENGL_WAYLAND_MIN_LOG_LEVEL=LOG_LEVEL_WARNING, say, compiles the
+// levels below it out, arguments and all.
+class Log {
+ public:
+  static const uint32_t kBurst = 32;
+
+  // Reads OPENGL_WAYLAND_LOG and starts the writer thread.
+  static void init();
+  // Writes what is queued and stops the writer thread.
+  static void shutdown();
+
+  static bool enabled(int level) {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+  // |suppressed| is how many messages the call site dropped before this.
+  static void write(int level, uint32_t suppressed, const char* format, ...)
+      __attribute__((format(printf, 3, 4)));
+
+ private:
+  static std::atomic<int> level_;
+};
+
+// The rate limit of one call site.
+class LogRate {
+ public:
+  LogRate() : window_start_(0), count_(0), suppressed_(0) {}
+
+  // Whether the site may log now. If so, |suppressed| is set to the number
+  // of messages it was not allowed since it last logged.
+  bool allow(uint32_t* suppressed);
+
+ private:
+  std::atomic<int64_t> window_start_;
+  std::atomic<uint32_t> count_;
+  std::atomic<uint32_t> suppressed_;
+};
+
+#ifndef OPENGL_WAYLAND_MIN_LOG_LEVEL
+#define OPENGL_WAYLAND_MIN_LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_AT(level, ...)                                   \
+  do {                                                       \
+    if (Log::enabled(level)) {                               \
+      static LogRate log_rate;                               \
+      uint32_t log_suppressed = 0;                           \
+      if (log_rate.allow(&log_suppressed))                   \
+        Log::write(level, log_suppressed, __VA_ARGS__);      \
+    }                                                        \
+  } while (0)
+#define LOG_STRIPPED(...) \
+  do {                    \
+  } while (0)
+
+#if OPENGL_WAYLAND_MIN_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+#if OPENGL_WAYLAND_MIN_LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+#if OPENGL_WAYLAND_MIN_LOG_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+#if OPENGL_WAYLAND_MIN_LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#endif
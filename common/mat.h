@@ -0,0 +1,254 @@
+#ifndef GED_MAT_H
+#define GED_MAT_H
+
+namespace ged {
+
+// Trigonometry usable in constant expressions. Evaluated in double precision
+// and accurate to well under a float ulp for the angles a projection or a
+// fixed transform uses; not meant for per-frame code.
+namespace constexpr_math {
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr double Sin(double x) {
+  // Reduce to [-pi, pi] and sum the Taylor series.
+  long long turns = static_cast<long long>(x / (2.0 * kPi));
+  x -= turns * 2.0 * kPi;
+  if (x > kPi)
+    x -= 2.0 * kPi;
+  else if (x < -kPi)
+    x += 2.0 * kPi;
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 12; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double Cos(double x) {
+  return Sin(x + kPi / 2.0);
+}
+
+constexpr double Tan(double x) {
+  return Sin(x) / Cos(x);
+}
+
+constexpr double Sqrt(double x) {
+  if (x <= 0.0)
+    return 0.0;
+  double r = x > 1.0 ? x : 1.0;
+  for (int i = 0; i < 64; i++) {
+    double next = 0.5 * (r + x / r);
+    if (next == r)
+      break;
+    r = next;
+  }
+  return r;
+}
+
+}  // namespace constexpr_math
+
+// Fixed-size square matrix that can be built in constant expressions, so
+// static projections and transforms fold into .rodata instead of being
+// recomputed every frame.
+//
+// The layout and the builder semantics are those of Matrix: the builders
+// multiply the new transform in as the Matrix method of the same name does,
+// in the same order, so
+//
+//   constexpr Mat<4> kModelview =
+//       Mat<4>::Identity().Translate(0.0f, 0.0f, -2.0f).Rotate(...);
+//
+// holds what the equivalent Matrix calls produce at run time, up to
+// rounding, and Matrix(kModelview) converts it. The trigonometry here is
+// correctly rounded, and sinf(), cosf() and tanf() need not be, so
+// Rotate() and Perspective() can differ from Matrix in the last bit.
+template <int N>
+struct Mat {
+  float m[N][N];
+
+  static constexpr Mat Identity() {
+    Mat r = {};
+    for (int i = 0; i < N; i++)
+      r.m[i][i] = 1.0f;
+    return r;
+  }
+
+  constexpr const float* Data() const { return &m[0][0]; }
+
+  // this * op, as Matrix::MatrixMultiply.
+  constexpr Mat MatrixMultiply(const Mat& op) const {
+    Mat r = {};
+    for (int i = 0; i < N; i++) {
+      for (int j = 0; j < N; j++) {
+        // Not from 0.0f, which would turn a -0 product into +0.
+        float sum = m[i][0] * op.m[0][j];
+        for (int k = 1; k < N; k++)
+          sum += m[i][k] * op.m[k][j];
+        r.m[i][j] = sum;
+      }
+    }
+    return r;
+  }
+
+  constexpr Mat Transposed() const {
+    Mat r = {};
+    for (int i = 0; i < N; i++) {
+      for (int j = 0; j < N; j++)
+        r.m[i][j] = m[j][i];
+    }
+    return r;
+  }
+
+  // Upper-left block, e.g. the normal matrix of a 4x4 transform.
+  constexpr Mat<N - 1> Minor() const {
+    Mat<N - 1> r = {};
+    for (int i = 0; i < N - 1; i++) {
+      for (int j = 0; j < N - 1; j++)
+        r.m[i][j] = m[i][j];
+    }
+    return r;
+  }
+
+  // The builders below exist for 4x4 matrices only.
+
+  constexpr Mat Scale(float sx, float sy, float sz) const {
+    static_assert(N == 4, "Scale needs a 4x4 matrix");
+    Mat r = *this;
+    for (int j = 0; j < 4; j++) {
+      r.m[0][j] *= sx;
+      r.m[1][j] *= sy;
+      r.m[2][j] *= sz;
+    }
+    return r;
+  }
+
+  constexpr Mat Translate(float tx, float ty, float tz) const {
+    static_assert(N == 4, "Translate needs a 4x4 matrix");
+    Mat r = *this;
+    for (int j = 0; j < 4; j++)
+      r.m[3][j] += (m[0][j] * tx + m[1][j] * ty + m[2][j] * tz);
+    return r;
+  }
+
+  /// \param angle Rotation angle in degrees
+  constexpr Mat Rotate(float angle, float x, float y, float z) const {
+    static_assert(N == 4, "Rotate needs a 4x4 matrix");
+    // Evaluated in the order of Matrix::Rotate, product by product.
+    float mag = static_cast<float>(constexpr_math::Sqrt(x * x + y * y + z * z));
+    if (mag <= 0.0f)
+      return *this;
+    x /= mag;
+    y /= mag;
+    z /= mag;
+    float xx = x * x;
+    float yy = y * y;
+    float zz = z * z;
+    float xy = x * y;
+    float yz = y * z;
+    float zx = z * x;
+    float radians = angle * static_cast<float>(constexpr_math::kPi / 180.0);
+    float s = static_cast<float>(constexpr_math::Sin(radians));
+    float c = static_cast<float>(constexpr_math::Cos(radians));
+    float xs = x * s;
+    float ys = y * s;
+    float zs = z * s;
+    float one_c = 1.0f - c;
+
+    float rot[3][3] = {};
+    rot[0][0] = (one_c * xx) + c;
+    rot[0][1] = (one_c * xy) - zs;
+    rot[0][2] = (one_c * zx) + ys;
+    rot[1][0] = (one_c * xy) + zs;
+    rot[1][1] = (one_c * yy) + c;
+    rot[1][2] = (one_c * yz) - xs;
+    rot[2][0] = (one_c * zx) - ys;
+    rot[2][1] = (one_c * yz) + xs;
+    rot[2][2] = (one_c * zz) + c;
+
+    // rot * this, as Matrix::PreMultiply3x3: the last row stays.
+    Mat r = *this;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 4; j++) {
+        r.m[i][j] = rot[i][0] * m[0][j];
+        r.m[i][j] += rot[i][1] * m[1][j];
+        r.m[i][j] += rot[i][2] * m[2][j];
+      }
+    }
+    return r;
+  }
+
+  constexpr Mat Frustum(float left,
+                        float right,
+                        float bottom,
+                        float top,
+                        float nearZ,
+                        float farZ) const {
+    static_assert(N == 4, "Frustum needs a 4x4 matrix");
+    float deltaX = right - left;
+    float deltaY = top - bottom;
+    float deltaZ = farZ - nearZ;
+    if ((nearZ <= 0.0f) || (farZ <= 0.0f) || (deltaX <= 0.0f) ||
+        (deltaY <= 0.0f) || (deltaZ <= 0.0f))
+      return *this;
+
+    // frust * this over the non-zero entries of frust, as Matrix::Frustum
+    // computes it.
+    float a = (right + left) / deltaX;
+    float b = (top + bottom) / deltaY;
+    float c = -(nearZ + farZ) / deltaZ;
+    Mat r = {};
+    for (int j = 0; j < 4; j++) {
+      r.m[0][j] = 2.0f * nearZ / deltaX * m[0][j];
+      r.m[1][j] = 2.0f * nearZ / deltaY * m[1][j];
+      r.m[2][j] = a * m[0][j] + b * m[1][j] + c * m[2][j] - m[3][j];
+      r.m[3][j] = -2.0f * nearZ * farZ / deltaZ * m[2][j];
+    }
+    return r;
+  }
+
+  /// \param fovy Field of view y angle in degrees
+  constexpr Mat Perspective(float fovy,
+                            float aspect,
+                            float nearZ,
+                            float farZ) const {
+    // tanf() takes the angle as a float, as Matrix::Perspective passes it.
+    float radians = static_cast<float>(fovy / 360.0f * constexpr_math::kPi);
+    float frustumH = static_cast<float>(constexpr_math::Tan(radians)) * nearZ;
+    float frustumW = frustumH * aspect;
+    return Frustum(-frustumW, frustumW, -frustumH, frustumH, nearZ, farZ);
+  }
+
+  constexpr Mat Ortho(float left,
+                      float right,
+                      float bottom,
+                      float top,
+                      float nearZ,
+                      float farZ) const {
+    static_assert(N == 4, "Ortho needs a 4x4 matrix");
+    float deltaX = right - left;
+    float deltaY = top - bottom;
+    float deltaZ = farZ - nearZ;
+    if ((deltaX == 0.0f) || (deltaY == 0.0f) || (deltaZ == 0.0f))
+      return *this;
+
+    // ortho * this, as Matrix::Ortho computes it.
+    float a = -(right + left) / deltaX;
+    float b = -(top + bottom) / deltaY;
+    float c = -(nearZ + farZ) / deltaZ;
+    Mat r = {};
+    for (int j = 0; j < 4; j++) {
+      r.m[0][j] = 2.0f / deltaX * m[0][j];
+      r.m[1][j] = 2.0f / deltaY * m[1][j];
+      r.m[2][j] = -2.0f / deltaZ * m[2][j];
+      r.m[3][j] = a * m[0][j] + b * m[1][j] + c * m[2][j] + m[3][j];
+    }
+    return r;
+  }
+};
+
+}  // namespace ged
+
+#endif  // GED_MAT_H
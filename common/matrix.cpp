@@ -39,20 +39,25 @@
 
 #include "matrix.h"
 
-#include <algorithm>
 #include <cmath>
 #include <cstring>
 
+#include "quaternion.h"
+#include "simd.h"
+
 namespace ged {
 
+using namespace simd;
+
 Matrix::Matrix() {
   InitIdentity();
 }
 
-Matrix::~Matrix() {}
-
 void Matrix::operator=(const Matrix& other) {
-  std::copy(&other.m_[0][0], &other.m_[3][3] + 1, &m_[0][0]);
+  Store(m_[0], Load(other.m_[0]));
+  Store(m_[1], Load(other.m_[1]));
+  Store(m_[2], Load(other.m_[2]));
+  Store(m_[3], Load(other.m_[3]));
 }
 
 const float* Matrix::Data() const {
@@ -80,38 +85,88 @@ void Matrix::InitIdentity() {
 }
 
 void Matrix::MatrixMultiply(const Matrix& op) {
-  Matrix tmp;
+  // Row i of the product only depends on row i of this matrix, so the result
+  // can be written in place. The operand rows are loaded up front, which also
+  // keeps m.MatrixMultiply(m) correct.
+  Float4 b0 = Load(op.m_[0]);
+  Float4 b1 = Load(op.m_[1]);
+  Float4 b2 = Load(op.m_[2]);
+  Float4 b3 = Load(op.m_[3]);
   for (int i = 0; i < 4; i++) {
-    tmp.m_[i][0] = (m_[i][0] * op.m_[0][0]) + (m_[i][1] * op.m_[1][0]) +
-                   (m_[i][2] * op.m_[2][0]) + (m_[i][3] * op.m_[3][0]);
-
-    tmp.m_[i][1] = (m_[i][0] * op.m_[0][1]) + (m_[i][1] * op.m_[1][1]) +
-                   (m_[i][2] * op.m_[2][1]) + (m_[i][3] * op.m_[3][1]);
-
-    tmp.m_[i][2] = (m_[i][0] * op.m_[0][2]) + (m_[i][1] * op.m_[1][2]) +
-                   (m_[i][2] * op.m_[2][2]) + (m_[i][3] * op.m_[3][2]);
-
-    tmp.m_[i][3] = (m_[i][0] * op.m_[0][3]) + (m_[i][1] * op.m_[1][3]) +
-                   (m_[i][2] * op.m_[2][3]) + (m_[i][3] * op.m_[3][3]);
+    Float4 row = Mul(Splat(m_[i][0]), b0);
+    row = MulAdd(Splat(m_[i][1]), b1, row);
+    row = MulAdd(Splat(m_[i][2]), b2, row);
+    row = MulAdd(Splat(m_[i][3]), b3, row);
+    Store(m_[i], row);
   }
-  std::copy(&tmp.m_[0][0], &tmp.m_[3][3] + 1, &m_[0][0]);
 }
 
-void Matrix::Scale(float sx, float sy, float sz) {
-  m_[0][0] *= sx;
-  m_[0][1] *= sx;
-  m_[0][2] *= sx;
-  m_[0][3] *= sx;
+void Matrix::Transpose() {
+  Float4 r0 = Load(m_[0]);
+  Float4 r1 = Load(m_[1]);
+  Float4 r2 = Load(m_[2]);
+  Float4 r3 = Load(m_[3]);
+  simd::Transpose(r0, r1, r2, r3);
+  Store(m_[0], r0);
+  Store(m_[1], r1);
+  Store(m_[2], r2);
+  Store(m_[3], r3);
+}
 
-  m_[1][0] *= sy;
-  m_[1][1] *= sy;
-  m_[1][2] *= sy;
-  m_[1][3] *= sy;
+bool Matrix::Inverse() {
+  // Cofactor expansion over the 2x2 sub-determinants of the top two rows
+  // (s0..s5) and the bottom two rows (c0..c5).
+  Float4 r0 = Load(m_[0]);
+  Float4 r1 = Load(m_[1]);
+  Float4 r2 = Load(m_[2]);
+  Float4 r3 = Load(m_[3]);
+
+  alignas(16) float s[8];
+  alignas(16) float c[8];
+  Store(s, Sub(Mul(Shuffle<0, 0, 0, 1>(r0), Shuffle<1, 2, 3, 2>(r1)),
+               Mul(Shuffle<0, 0, 0, 1>(r1), Shuffle<1, 2, 3, 2>(r0))));
+  Store(s + 4, Sub(Mul(Shuffle<1, 2, 1, 2>(r0), Shuffle<3, 3, 3, 3>(r1)),
+                   Mul(Shuffle<1, 2, 1, 2>(r1), Shuffle<3, 3, 3, 3>(r0))));
+  Store(c, Sub(Mul(Shuffle<0, 0, 0, 1>(r2), Shuffle<1, 2, 3, 2>(r3)),
+               Mul(Shuffle<0, 0, 0, 1>(r3), Shuffle<1, 2, 3, 2>(r2))));
+  Store(c + 4, Sub(Mul(Shuffle<1, 2, 1, 2>(r2), Shuffle<3, 3, 3, 3>(r3)),
+                   Mul(Shuffle<1, 2, 1, 2>(r3), Shuffle<3, 3, 3, 3>(r2))));
+
+  float det = s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] -
+              s[4] * c[1] + s[5] * c[0];
+  if (det == 0.0f)
+    return false;
+  float inv_det = 1.0f / det;
+
+  // v[j] holds column j as (a1j, a0j, a3j, a2j), which lines the elements up
+  // with the (c, c, s, s) factors below.
+  simd::Transpose(r0, r1, r2, r3);
+  Float4 v0 = Shuffle<1, 0, 3, 2>(r0);
+  Float4 v1 = Shuffle<1, 0, 3, 2>(r1);
+  Float4 v2 = Shuffle<1, 0, 3, 2>(r2);
+  Float4 v3 = Shuffle<1, 0, 3, 2>(r3);
+
+  Float4 f0 = Set(c[0], c[0], s[0], s[0]);
+  Float4 f1 = Set(c[1], c[1], s[1], s[1]);
+  Float4 f2 = Set(c[2], c[2], s[2], s[2]);
+  Float4 f3 = Set(c[3], c[3], s[3], s[3]);
+  Float4 f4 = Set(c[4], c[4], s[4], s[4]);
+  Float4 f5 = Set(c[5], c[5], s[5], s[5]);
+
+  Float4 even = Set(inv_det, -inv_det, inv_det, -inv_det);
+  Float4 odd = Set(-inv_det, inv_det, -inv_det, inv_det);
+
+  Store(m_[0], Mul(Add(Sub(Mul(v1, f5), Mul(v2, f4)), Mul(v3, f3)), even));
+  Store(m_[1], Mul(Add(Sub(Mul(v0, f5), Mul(v2, f2)), Mul(v3, f1)), odd));
+  Store(m_[2], Mul(Add(Sub(Mul(v0, f4), Mul(v1, f2)), Mul(v3, f0)), even));
+  Store(m_[3], Mul(Add(Sub(Mul(v0, f3), Mul(v1, f1)), Mul(v2, f0)), odd));
+  return true;
+}
 
-  m_[2][0] *= sz;
-  m_[2][1] *= sz;
-  m_[2][2] *= sz;
-  m_[2][3] *= sz;
+void Matrix::Scale(float sx, float sy, float sz) {
+  Store(m_[0], Mul(Load(m_[0]), Splat(sx)));
+  Store(m_[1], Mul(Load(m_[1]), Splat(sy)));
+  Store(m_[2], Mul(Load(m_[2]), Splat(sz)));
 }
 
 void Matrix::Translate(float tx, float ty, float tz) {
@@ -122,10 +177,10 @@ void Matrix::Translate(float tx, float ty, float tz) {
 }
 
 void Matrix::Rotate(float angle, float x, float y, float z) {
-  float mag = sqrt(x * x + y * y + z * z);
+  float mag = sqrtf(x * x + y * y + z * z);
   if (mag > 0.0f) {
     float xx, yy, zz, xy, yz, zx, xs, ys, zs;
-    Matrix rot_mat;
+    float rot[3][3];
 
     x /= mag;
     y /= mag;
@@ -137,35 +192,48 @@ void Matrix::Rotate(float angle, float x, float y, float z) {
     xy = x * y;
     yz = y * z;
     zx = z * x;
-    float sin_angle = sin(angle * M_PI / 180.0f);
-    float cos_angle = cos(angle * M_PI / 180.0f);
+    // Keep the trigonometry in single precision; M_PI is a double.
+    float radians = angle * static_cast<float>(M_PI / 180.0);
+    float sin_angle = sinf(radians);
+    float cos_angle = cosf(radians);
     xs = x * sin_angle;
     ys = y * sin_angle;
     zs = z * sin_angle;
     float one_cos = 1.0f - cos_angle;
 
-    rot_mat.m_[0][0] = (one_cos * xx) + cos_angle;
-    rot_mat.m_[0][1] = (one_cos * xy) - zs;
-    rot_mat.m_[0][2] = (one_cos * zx) + ys;
-    rot_mat.m_[0][3] = 0.0F;
+    rot[0][0] = (one_cos * xx) + cos_angle;
+    rot[0][1] = (one_cos * xy) - zs;
+    rot[0][2] = (one_cos * zx) + ys;
 
-    rot_mat.m_[1][0] = (one_cos * xy) + zs;
-    rot_mat.m_[1][1] = (one_cos * yy) + cos_angle;
-    rot_mat.m_[1][2] = (one_cos * yz) - xs;
-    rot_mat.m_[1][3] = 0.0F;
+    rot[1][0] = (one_cos * xy) + zs;
+    rot[1][1] = (one_cos * yy) + cos_angle;
+    rot[1][2] = (one_cos * yz) - xs;
 
-    rot_mat.m_[2][0] = (one_cos * zx) - ys;
-    rot_mat.m_[2][1] = (one_cos * yz) + xs;
-    rot_mat.m_[2][2] = (one_cos * zz) + cos_angle;
-    rot_mat.m_[2][3] = 0.0F;
+    rot[2][0] = (one_cos * zx) - ys;
+    rot[2][1] = (one_cos * yz) + xs;
+    rot[2][2] = (one_cos * zz) + cos_angle;
 
-    rot_mat.m_[3][0] = 0.0F;
-    rot_mat.m_[3][1] = 0.0F;
-    rot_mat.m_[3][2] = 0.0F;
-    rot_mat.m_[3][3] = 1.0F;
+    PreMultiply3x3(rot);
+  }
+}
 
-    rot_mat.MatrixMultiply(*this);
-    *this = rot_mat;
+void Matrix::Rotate(const Quaternion& q) {
+  float rot[3][3];
+  q.To3x3(rot);
+  PreMultiply3x3(rot);
+}
+
+void Matrix::PreMultiply3x3(const float rot[3][3]) {
+  // The rotation's last row and column are those of the identity, so only
+  // the upper three rows change and no temporary matrix is needed.
+  Float4 m0 = Load(m_[0]);
+  Float4 m1 = Load(m_[1]);
+  Float4 m2 = Load(m_[2]);
+  for (int i = 0; i < 3; i++) {
+    Float4 row = Mul(Splat(rot[i][0]), m0);
+    row = MulAdd(Splat(rot[i][1]), m1, row);
+    row = MulAdd(Splat(rot[i][2]), m2, row);
+    Store(m_[i], row);
   }
 }
 
@@ -182,23 +250,26 @@ void Matrix::Frustum(float left,
       (deltaY <= 0.0f) || (deltaZ <= 0.0f))
     return;
 
-  Matrix frust;
-  frust.m_[0][0] = 2.0f * nearZ / deltaX;
-  frust.m_[0][1] = frust.m_[0][2] = frust.m_[0][3] = 0.0f;
-
-  frust.m_[1][1] = 2.0f * nearZ / deltaY;
-  frust.m_[1][0] = frust.m_[1][2] = frust.m_[1][3] = 0.0f;
-
-  frust.m_[2][0] = (right + left) / deltaX;
-  frust.m_[2][1] = (top + bottom) / deltaY;
-  frust.m_[2][2] = -(nearZ + farZ) / deltaZ;
-  frust.m_[2][3] = -1.0f;
-
-  frust.m_[3][2] = -2.0f * nearZ * farZ / deltaZ;
-  frust.m_[3][0] = frust.m_[3][1] = frust.m_[3][3] = 0.0f;
-
-  frust.MatrixMultiply(*this);
-  *this = frust;
+  // this = frust * this, expanded over the non-zero entries of the
+  // frustum matrix:
+  //   | 2n/dx  0      0               0  |
+  //   | 0      2n/dy  0               0  |
+  //   | r+l/dx t+b/dy -(n+f)/dz      -1  |
+  //   | 0      0      -2nf/dz         0  |
+  Float4 m0 = Load(m_[0]);
+  Float4 m1 = Load(m_[1]);
+  Float4 m2 = Load(m_[2]);
+  Float4 m3 = Load(m_[3]);
+
+  Float4 row2 = Mul(Splat((right + left) / deltaX), m0);
+  row2 = MulAdd(Splat((top + bottom) / deltaY), m1, row2);
+  row2 = MulAdd(Splat(-(nearZ + farZ) / deltaZ), m2, row2);
+  row2 = Sub(row2, m3);
+
+  Store(m_[0], Mul(Splat(2.0f * nearZ / deltaX), m0));
+  Store(m_[1], Mul(Splat(2.0f * nearZ / deltaY), m1));
+  Store(m_[2], row2);
+  Store(m_[3], Mul(Splat(-2.0f * nearZ * farZ / deltaZ), m2));
 }
 
 void Matrix::Perspective(float fovy, float aspect, float nearZ, float farZ) {
@@ -207,4 +278,34 @@ void Matrix::Perspective(float fovy, float aspect, float nearZ, float farZ) {
   Frustum(-frustumW, frustumW, -frustumH, frustumH, nearZ, farZ);
 }
 
+void Matrix::Ortho(float left,
+                   float right,
+                   float bottom,
+                   float top,
+                   float nearZ,
+                   float farZ) {
+  float deltaX = right - left;
+  float deltaY = top - bottom;
+  float deltaZ = farZ - nearZ;
+  if ((deltaX == 0.0f) || (deltaY == 0.0f) || (deltaZ == 0.0f))
+    return;
+
+  // this = ortho * this; the ortho matrix is diagonal apart from its
+  // translation row.
+  Float4 m0 = Load(m_[0]);
+  Float4 m1 = Load(m_[1]);
+  Float4 m2 = Load(m_[2]);
+  Float4 m3 = Load(m_[3]);
+
+  Float4 row3 = Mul(Splat(-(right + left) / deltaX), m0);
+  row3 = MulAdd(Splat(-(top + bottom) / deltaY), m1, row3);
+  row3 = MulAdd(Splat(-(nearZ + farZ) / deltaZ), m2, row3);
+  row3 = Add(row3, m3);
+
+  Store(m_[0], Mul(Splat(2.0f / deltaX), m0));
+  Store(m_[1], Mul(Splat(2.0f / deltaY), m1));
+  Store(m_[2], Mul(Splat(-2.0f / deltaZ), m2));
+  Store(m_[3], row3);
+}
+
 }  // namespace ged
@@ -23,22 +23,42 @@
 #ifndef GED_MATRIX_H
 #define GED_MATRIX_H
 
+#include "mat.h"
+
 namespace ged {
 
+class Quaternion;
+
 class Matrix {
  public:
   Matrix();
-  ~Matrix();
+  // Takes a matrix built at compile time, see mat.h. Matrix has a trivial
+  // destructor, so constant Matrix objects are literals as well.
+  constexpr explicit Matrix(const Mat<4>& m)
+      : m_{{m.m[0][0], m.m[0][1], m.m[0][2], m.m[0][3]},
+           {m.m[1][0], m.m[1][1], m.m[1][2], m.m[1][3]},
+           {m.m[2][0], m.m[2][1], m.m[2][2], m.m[2][3]},
+           {m.m[3][0], m.m[3][1], m.m[3][2], m.m[3][3]}} {}
   Matrix(const Matrix&) = default;
   void operator=(const Matrix&);
 
   const float* Data() const;
   void Get3x3(float* m3x3) const;
 
+  // this = this * op. Kernels are SSE2 or NEON when available, see simd.h;
+  // the scalar build gives bit-identical results, as "make matrix_check"
+  // verifies.
   void MatrixMultiply(const Matrix& op);
+  void Transpose();
+  // Replaces the matrix with its inverse. Returns false and leaves the matrix
+  // untouched if it is singular.
+  bool Inverse();
   void Scale(float sx, float sy, float sz);
   void Translate(float tx, float ty, float tz);
   void Rotate(float angle, float x, float y, float z);
+  // Same as Rotate(angle, x, y, z) for the quaternion of that angle and axis.
+  // Compose rotations as quaternions and apply them once, see quaternion.h.
+  void Rotate(const Quaternion& q);
 
   // \brief multiply matrix specified by result with a perspective matrix and
   // return new matrix in result
@@ -67,9 +87,26 @@ class Matrix {
   /// \param farZ Far plane distance
   void Perspective(float fovy, float aspect, float nearZ, float farZ);
 
+  /// \brief multiply matrix specified by result with a orthographic
+  /// projection matrix and return new matrix in result
+  /// \param left, right Coordinates for the left and right vertical clipping
+  /// planes
+  /// \param bottom, top Coordinates for the bottom and top horizontal clipping
+  /// planes
+  /// \param nearZ, farZ Distances to the near and far depth clipping planes.
+  void Ortho(float left,
+             float right,
+             float bottom,
+             float top,
+             float nearZ,
+             float farZ);
+
  private:
   void InitIdentity();
-  float m_[4][4];
+  // this = rot * this, where rot is a rotation with |rot3x3| as its upper
+  // 3x3 block.
+  void PreMultiply3x3(const float rot3x3[3][3]);
+  alignas(16) float m_[4][4];
 };
 
 }  // namespace ged
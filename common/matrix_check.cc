@@ -0,0 +1,86 @@
+// Prints the bits of matrices computed with the kernels from simd.h, for
+// fixed pseudo-random inputs. "make matrix_check" builds it once with the
+// SSE2 or NEON backend and once with GED_SIMD_SCALAR, and compares the two
+// outputs: matrix.h promises they are bit-identical.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "matrix.h"
+#include "quaternion.h"
+#include "transform_batch.h"
+
+namespace {
+
+const int kCases = 1000;
+const size_t kBatchSize = 37;  // Not a multiple of four, for the tail.
+
+uint32_t random_state = 2463534242u;
+
+// In [-range, range), with a fractional part.
+float RandomFloat(float range) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state % 20000) / 10000.0f * range - range;
+}
+
+ged::Matrix RandomMatrix() {
+  ged::Matrix m;
+  m.Translate(RandomFloat(10.0f), RandomFloat(10.0f), RandomFloat(10.0f));
+  m.Rotate(RandomFloat(180.0f), RandomFloat(1.0f), RandomFloat(1.0f),
+           RandomFloat(1.0f));
+  m.Scale(RandomFloat(4.0f), RandomFloat(4.0f), RandomFloat(4.0f));
+  return m;
+}
+
+void Print(const char* name, int i, const float* values, size_t count) {
+  printf("%s %d", name, i);
+  for (size_t j = 0; j < count; j++) {
+    uint32_t bits;
+    memcpy(&bits, &values[j], sizeof(bits));
+    printf(" %08x", bits);
+  }
+  printf("\n");
+}
+
+}  // namespace
+
+int main() {
+  for (int i = 0; i < kCases; i++) {
+    ged::Matrix a = RandomMatrix();
+    ged::Matrix b = RandomMatrix();
+    a.MatrixMultiply(b);
+    Print("multiply", i, a.Data(), 16);
+
+    ged::Matrix projection;
+    projection.Perspective(30.0f + RandomFloat(20.0f), 1.5f, 1.0f, 50.0f);
+    b.MatrixMultiply(projection);
+    Print("perspective", i, b.Data(), 16);
+
+    ged::Matrix inverse = RandomMatrix();
+    bool invertible = inverse.Inverse();
+    Print(invertible ? "inverse" : "singular", i, inverse.Data(), 16);
+  }
+
+  for (int i = 0; i < kCases / 10; i++) {
+    ged::TransformBatch batch(kBatchSize);
+    for (size_t j = 0; j < kBatchSize; j++) {
+      batch.SetPosition(j, RandomFloat(10.0f), RandomFloat(10.0f),
+                        RandomFloat(10.0f));
+      ged::Quaternion q(RandomFloat(1.0f), RandomFloat(1.0f),
+                        RandomFloat(1.0f), RandomFloat(1.0f));
+      q.Normalize();
+      batch.SetRotation(j, q);
+      batch.SetScale(j, RandomFloat(4.0f), RandomFloat(4.0f),
+                     RandomFloat(4.0f));
+    }
+    std::vector<float> mvp(16 * kBatchSize);
+    batch.ComputeMVP(RandomMatrix(), mvp.data());
+    Print("batch", i, mvp.data(), mvp.size());
+  }
+  return 0;
+}
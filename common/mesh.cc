@@ -0,0 +1,213 @@
+#include "mesh.h"
+
+#include <assert.h>
+
+#include <GLES3/gl3.h>
+
+void matrix_instance_attribs(GLuint location,
+                             GLintptr offset,
+                             VertexAttrib attribs[kMatrixAttribCount]) {
+  for (int i = 0; i < kMatrixAttribCount; i++) {
+    VertexAttrib column = {
+        location + i, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat),
+        offset + i * 4 * static_cast<GLintptr>(sizeof(GLfloat)), 0};
+    attribs[i] = column;
+  }
+}
+
+MeshManager::MeshManager()
+    : bound_(0), enabled_attribs_(0), use_vertex_arrays_(false) {}
+
+void MeshManager::init(bool use_vertex_arrays) {
+  use_vertex_arrays_ = use_vertex_arrays;
+}
+
+MeshManager::Mesh* MeshManager::get(MeshHandle mesh) {
+  assert(mesh > 0 && mesh <= meshes_.size());
+  return &meshes_[mesh - 1];
+}
+
+GLuint MeshManager::vertex_buffer(MeshHandle mesh, int stream) const {
+  assert(mesh > 0 && mesh <= meshes_.size());
+  return meshes_[mesh - 1].vbo[stream];
+}
+
+MeshHandle MeshManager::create_mesh(const MeshData& data) {
+  Mesh mesh = {};
+  mesh.vertex_count = data.vertex_count;
+  mesh.index_count = data.index_count;
+  mesh.index_type = data.index_type;
+  mesh.attribs.assign(data.attribs, data.attribs + data.attrib_count);
+
+  for (int i = 0; i < kMaxVertexStreams; i++) {
+    if (!data.vertices[i])
+      continue;
+    glGenBuffers(1, &mesh.vbo[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[i]);
+    glBufferData(GL_ARRAY_BUFFER, data.vertex_bytes[i], data.vertices[i],
+                 GL_STATIC_DRAW);
+  }
+
+  if (use_vertex_arrays_) {
+    // The element array binding is part of the vertex array object, so the
+    // index buffer is created with the VAO bound.
+    unbind();
+    glGenVertexArrays(1, &mesh.vao);
+    glBindVertexArray(mesh.vao);
+  }
+
+  if (data.indices) {
+    GLsizeiptr index_size =
+        data.index_type == GL_UNSIGNED_BYTE
+            ? 1
+            : data.index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    glGenBuffers(1, &mesh.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_size * data.index_count,
+                 data.indices, GL_STATIC_DRAW);
+  }
+
+  if (use_vertex_arrays_) {
+    setup_attribs(mesh);
+    glBindVertexArray(0);
+  } else {
+    // bind() sets the element array binding again for this mesh.
+    bound_ = 0;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  meshes_.push_back(mesh);
+  return meshes_.size();
+}
+
+void MeshManager::setup_attribs(const Mesh& mesh) {
+  unsigned enabled = 0;
+  GLuint bound_vbo = 0;
+  for (const VertexAttrib& attrib : mesh.attribs) {
+    GLuint vbo = mesh.vbo[attrib.stream];
+    if (vbo != bound_vbo) {
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      bound_vbo = vbo;
+    }
+    glVertexAttribPointer(attrib.index, attrib.size, attrib.type,
+                          attrib.normalized, attrib.stride,
+                          reinterpret_cast<const void*>(attrib.offset));
+    glEnableVertexAttribArray(attrib.index);
+    enabled |= 1u << attrib.index;
+  }
+
+  if (!use_vertex_arrays_) {
+    // Leave only this mesh's arrays enabled.
+    unsigned stale = enabled_attribs_ & ~enabled;
+    for (GLuint i = 0; stale; i++, stale >>= 1) {
+      if (stale & 1)
+        glDisableVertexAttribArray(i);
+    }
+    enabled_attribs_ = enabled;
+  }
+}
+
+void MeshManager::destroy_mesh(MeshHandle handle) {
+  Mesh* mesh = get(handle);
+  if (bound_ == handle)
+    unbind();
+  if (mesh->vao)
+    glDeleteVertexArrays(1, &mesh->vao);
+  glDeleteBuffers(kMaxVertexStreams, mesh->vbo);
+  if (mesh->ibo)
+    glDeleteBuffers(1, &mesh->ibo);
+  // Handles stay stable, so the slot is cleared rather than erased.
+  *mesh = Mesh();
+}
+
+void MeshManager::destroy_all() {
+  for (MeshHandle handle = 1; handle <= meshes_.size(); handle++)
+    destroy_mesh(handle);
+  meshes_.clear();
+}
+
+void MeshManager::bind(MeshHandle handle) {
+  if (bound_ == handle)
+    return;
+
+  Mesh* mesh = get(handle);
+  if (use_vertex_arrays_) {
+    glBindVertexArray(mesh->vao);
+  } else {
+    setup_attribs(*mesh);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+  }
+  bound_ = handle;
+}
+
+void MeshManager::unbind() {
+  if (use_vertex_arrays_) {
+    glBindVertexArray(0);
+  } else {
+    for (GLuint i = 0; enabled_attribs_; i++, enabled_attribs_ >>= 1) {
+      if (enabled_attribs_ & 1)
+        glDisableVertexAttribArray(i);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  bound_ = 0;
+}
+
+void MeshManager::draw(MeshHandle handle, GLenum mode) {
+  Mesh* mesh = get(handle);
+  draw_range(handle, mode, 0,
+             mesh->ibo ? mesh->index_count : mesh->vertex_count);
+}
+
+void MeshManager::draw_instanced(MeshHandle handle,
+                                 GLenum mode,
+                                 GLsizei instance_count,
+                                 GLuint instance_buffer,
+                                 const VertexAttrib* instance_attribs,
+                                 int attrib_count) {
+  assert(use_vertex_arrays_);
+  bind(handle);
+  Mesh* mesh = get(handle);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  for (int i = 0; i < attrib_count; i++) {
+    const VertexAttrib& attrib = instance_attribs[i];
+    glVertexAttribPointer(attrib.index, attrib.size, attrib.type,
+                          attrib.normalized, attrib.stride,
+                          reinterpret_cast<const void*>(attrib.offset));
+    glVertexAttribDivisor(attrib.index, 1);
+    glEnableVertexAttribArray(attrib.index);
+  }
+
+  if (mesh->ibo) {
+    glDrawElementsInstanced(mode, mesh->index_count, mesh->index_type, 0,
+                            instance_count);
+  } else {
+    glDrawArraysInstanced(mode, 0, mesh->vertex_count, instance_count);
+  }
+
+  // The instance arrays were recorded in the mesh's vertex array object;
+  // take them out again so plain draws of the mesh are unaffected.
+  for (int i = 0; i < attrib_count; i++) {
+    glDisableVertexAttribArray(instance_attribs[i].index);
+    glVertexAttribDivisor(instance_attribs[i].index, 0);
+  }
+}
+
+void MeshManager::draw_range(MeshHandle handle,
+                             GLenum mode,
+                             GLint first,
+                             GLsizei count) {
+  bind(handle);
+  Mesh* mesh = get(handle);
+  if (mesh->ibo) {
+    GLintptr index_size = mesh->index_type == GL_UNSIGNED_BYTE
+                              ? 1
+                              : mesh->index_type == GL_UNSIGNED_SHORT ? 2 : 4;
+    glDrawElements(mode, count, mesh->index_type,
+                   reinterpret_cast<const void*>(first * index_size));
+  } else {
+    glDrawArrays(mode, first, count);
+  }
+}
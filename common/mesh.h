@@ -0,0 +1,103 @@
+#ifndef OPENGL_WAYLAND_MESH_H_
+#define OPENGL_WAYLAND_MESH_H_
+
+#include <GLES2/gl2.h>
+
+#include <vector>
+
+// Handle to a mesh owned by MeshManager. 0 is never a valid mesh.
+typedef unsigned MeshHandle;
+
+const int kMaxVertexStreams = 4;
+
+// A mat4 attribute takes four consecutive locations, one per column.
+const int kMatrixAttribCount = 4;
+
+// One vertex attribute, read from vertex stream |stream| of the mesh.
+struct VertexAttrib {
+  GLuint index;          // Attribute location in the shader.
+  GLint size;            // Number of components.
+  GLenum type;
+  GLboolean normalized;
+  GLsizei stride;        // 0 for tightly packed.
+  GLintptr offset;       // Byte offset of the first component.
+  int stream;
+};
+
+// Fills |attribs| for a per-instance mat4 at |location| whose instances are
+// tightly packed from |offset| on, in the layout of ged::Matrix::Data().
+void matrix_instance_attribs(GLuint location,
+                             GLintptr offset,
+                             VertexAttrib attribs[kMatrixAttribCount]);
+
+struct MeshData {
+  const void* vertices[kMaxVertexStreams];
+  GLsizeiptr vertex_bytes[kMaxVertexStreams];
+  GLsizei vertex_count;
+  const VertexAttrib* attribs;
+  int attrib_count;
+  // Optional index buffer.
+  const void* indices;
+  GLsizei index_count;
+  GLenum index_type;
+};
+
+// Uploads vertex and index data into buffer objects once and binds them for
+// drawing. With OpenGL ES 3 each mesh records its attribute setup in a vertex
+// array object, so binding is a single call; on ES 2 the attribute pointers
+// are set up again on every bind. Binding the mesh that is already bound does
+// nothing.
+class MeshManager {
+ public:
+  MeshManager();
+
+  // Must be called with the context current, before any other method.
+  void init(bool use_vertex_arrays);
+
+  MeshHandle create_mesh(const MeshData& data);
+  void destroy_mesh(MeshHandle mesh);
+  void destroy_all();
+
+  void bind(MeshHandle mesh);
+  // Restores the default vertex array, for code that draws from client
+  // memory or sets up attributes by hand.
+  void unbind();
+
+  // Draws all indices, or all vertices for a mesh without indices.
+  void draw(MeshHandle mesh, GLenum mode);
+  // Draws |count| vertices, or indices, starting at |first|.
+  void draw_range(MeshHandle mesh, GLenum mode, GLint first, GLsizei count);
+  // Draws |instance_count| copies of the whole mesh in one call. The
+  // |instance_attribs| are read from |instance_buffer| and advance once per
+  // instance; their |stream| is ignored. Needs OpenGL ES 3.
+  void draw_instanced(MeshHandle mesh,
+                      GLenum mode,
+                      GLsizei instance_count,
+                      GLuint instance_buffer,
+                      const VertexAttrib* instance_attribs,
+                      int attrib_count);
+
+  GLuint vertex_buffer(MeshHandle mesh, int stream) const;
+
+ private:
+  struct Mesh {
+    GLuint vao;
+    GLuint vbo[kMaxVertexStreams];
+    GLuint ibo;
+    GLsizei vertex_count;
+    GLsizei index_count;
+    GLenum index_type;
+    std::vector<VertexAttrib> attribs;
+  };
+
+  Mesh* get(MeshHandle mesh);
+  void setup_attribs(const Mesh& mesh);
+
+  std::vector<Mesh> meshes_;
+  MeshHandle bound_;
+  // Attribute arrays enabled by the last bind, ES 2 only.
+  unsigned enabled_attribs_;
+  bool use_vertex_arrays_;
+};
+
+#endif
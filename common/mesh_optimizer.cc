@@ -0,0 +1,250 @@
+#include "mesh_optimizer.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <vector>
+
+namespace ged {
+
+namespace {
+
+const unsigned kInvalid = ~0u;
+
+unsigned HashBytes(const unsigned char* data, size_t size) {
+  // FNV-1a.
+  unsigned hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Pops dead-end vertices, the ones touched most recently, until one still
+// has triangles left; failing that, scans forward from |cursor| for any
+// such vertex.
+unsigned SkipDeadEnd(std::vector<unsigned>* dead_end,
+                     const std::vector<unsigned>& live,
+                     size_t* cursor) {
+  while (!dead_end->empty()) {
+    unsigned v = dead_end->back();
+    dead_end->pop_back();
+    if (live[v])
+      return v;
+  }
+  for (; *cursor < live.size(); ++*cursor) {
+    if (live[*cursor])
+      return *cursor;
+  }
+  return kInvalid;
+}
+
+}  // namespace
+
+size_t DeduplicateVertices(const void* vertices,
+                           size_t vertex_count,
+                           size_t vertex_size,
+                           void* unique,
+                           unsigned* indices) {
+  const unsigned char* in = static_cast<const unsigned char*>(vertices);
+  unsigned char* out = static_cast<unsigned char*>(unique);
+
+  // Open addressing with a power of two table at most half full.
+  size_t table_size = 1;
+  while (table_size < vertex_count * 2)
+    table_size *= 2;
+  std::vector<unsigned> table(table_size, kInvalid);
+
+  size_t count = 0;
+  for (size_t i = 0; i < vertex_count; i++) {
+    const unsigned char* v = in + i * vertex_size;
+    size_t slot = HashBytes(v, vertex_size) & (table_size - 1);
+    while (table[slot] != kInvalid &&
+           memcmp(out + table[slot] * vertex_size, v, vertex_size) != 0)
+      slot = (slot + 1) & (table_size - 1);
+
+    if (table[slot] == kInvalid) {
+      // memmove, as |unique| may trail |vertices| in the same array.
+      memmove(out + count * vertex_size, v, vertex_size);
+      table[slot] = count++;
+    }
+    indices[i] = table[slot];
+  }
+  return count;
+}
+
+void OptimizeVertexCache(unsigned* destination,
+                         const unsigned* indices,
+                         size_t index_count,
+                         size_t vertex_count,
+                         unsigned cache_size) {
+  assert(index_count % 3 == 0);
+  // Nothing to reorder, and the buffers below would be empty.
+  if (!index_count)
+    return;
+  size_t triangle_count = index_count / 3;
+
+  // Triangles around each vertex, as offsets into one array.
+  std::vector<unsigned> live(vertex_count, 0);
+  for (size_t i = 0; i < index_count; i++)
+    live[indices[i]]++;
+  std::vector<unsigned> first(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; v++)
+    first[v + 1] = first[v] + live[v];
+  std::vector<unsigned> adjacency(index_count);
+  std::vector<unsigned> fill(first.begin(), first.end() - 1);
+  for (size_t i = 0; i < index_count; i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  std::vector<unsigned> output;
+  output.reserve(index_count);
+  std::vector<unsigned> cache_time(vertex_count, 0);
+  std::vector<bool> emitted(triangle_count, false);
+  std::vector<unsigned> dead_end;
+  std::vector<unsigned> candidates;
+  unsigned time = cache_size + 1;
+  size_t cursor = 0;
+
+  unsigned fan = vertex_count ? 0 : kInvalid;
+  while (fan != kInvalid) {
+    // Emit every remaining triangle around the fanning vertex.
+    candidates.clear();
+    for (unsigned a = first[fan]; a < first[fan + 1]; a++) {
+      unsigned t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = true;
+      for (int c = 0; c < 3; c++) {
+        unsigned v = indices[t * 3 + c];
+        output.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cache_time[v] > cache_size)
+          cache_time[v] = time++;
+      }
+    }
+
+    // Continue with the candidate that stays in the cache the longest
+    // while its remaining triangles are emitted.
+    unsigned next = kInvalid;
+    int best = -1;
+    for (unsigned v : candidates) {
+      if (!live[v])
+        continue;
+      int priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= cache_size)
+        priority = time - cache_time[v];
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    if (next == kInvalid)
+      next = SkipDeadEnd(&dead_end, live, &cursor);
+    fan = next;
+  }
+
+  assert(output.size() == index_count);
+  memcpy(destination, output.data(), index_count * sizeof(unsigned));
+}
+
+size_t OptimizeVertexFetch(void* destination,
+                           unsigned* indices,
+                           size_t index_count,
+                           const void* vertices,
+                           size_t vertex_count,
+                           size_t vertex_size) {
+  if (!index_count)
+    return 0;
+  const unsigned char* in = static_cast<const unsigned char*>(vertices);
+  std::vector<unsigned> remap(vertex_count, kInvalid);
+  std::vector<unsigned char> out(vertex_count * vertex_size);
+
+  size_t count = 0;
+  for (size_t i = 0; i < index_count; i++) {
+    unsigned v = indices[i];
+    if (remap[v] == kInvalid) {
+      memcpy(&out[count * vertex_size], in + v * vertex_size, vertex_size);
+      remap[v] = count++;
+    }
+    indices[i] = remap[v];
+  }
+
+  memcpy(destination, out.data(), count * vertex_size);
+  return count;
+}
+
+float AverageCacheMissRatio(const unsigned* indices,
+                            size_t index_count,
+                            unsigned cache_size) {
+  if (index_count < 3)
+    return 0.0f;
+  std::vector<unsigned> fifo;
+  size_t misses = 0;
+  for (size_t i = 0; i < index_count; i++) {
+    bool hit = false;
+    for (unsigned cached : fifo) {
+      if (cached == indices[i]) {
+        hit = true;
+        break;
+      }
+    }
+    if (hit)
+      continue;
+    misses++;
+    if (fifo.size() == cache_size)
+      fifo.erase(fifo.begin());
+    fifo.push_back(indices[i]);
+  }
+  return static_cast<float>(misses) / (index_count / 3);
+}
+
+uint16_t QuantizeHalf(float v) {
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t abs = bits & 0x7fffffff;
+
+  if (abs >= 0x7f800000) {
+    // Infinity stays infinity, NaN stays a quiet NaN.
+    return sign | (abs > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+  if (abs >= 0x477ff000) {
+    // Rounds to a value past the largest half.
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) {
+    // Subnormal half, or zero. Shift the mantissa with its implicit one
+    // into place and round to nearest even.
+    if (abs < 0x33000000)
+      return sign;
+    uint32_t mantissa = (abs & 0x007fffff) | 0x00800000;
+    int shift = 126 - (abs >> 23);
+    uint32_t half = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+      half++;
+    return sign | half;
+  }
+
+  // Rebias the exponent and round the mantissa to nearest even. A carry
+  // out of the mantissa correctly bumps the exponent.
+  uint32_t half = ((abs - 0x38000000) >> 13);
+  uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++;
+  return sign | half;
+}
+
+uint8_t QuantizeUnorm8(float v) {
+  if (!(v > 0.0f))
+    return 0;
+  if (v >= 1.0f)
+    return 255;
+  return static_cast<uint8_t>(v * 255.0f + 0.5f);
+}
+
+}  // namespace ged
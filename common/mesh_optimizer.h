@@ -0,0 +1,66 @@
+#ifndef GED_MESH_OPTIMIZER_H
+#define GED_MESH_OPTIMIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ged {
+
+// Preprocessing for static meshes, run once before the data is uploaded.
+// Vertices are opaque records of |vertex_size| bytes; indices describe a
+// triangle list. The usual pipeline is
+//
+//   count = DeduplicateVertices(corners, corner_count, size, vertices,
+//                               indices);
+//   OptimizeVertexCache(indices, indices, corner_count, count, 16);
+//   OptimizeVertexFetch(vertices, indices, corner_count, vertices, count,
+//                       size);
+//
+// followed by quantizing the attributes with the helpers at the end.
+
+// Merges bitwise identical vertices of an unindexed triangle list. Writes
+// the unique vertices to |unique| in order of first use and one index per
+// input vertex to |indices|, and returns the unique vertex count. |unique|
+// needs room for |vertex_count| vertices.
+size_t DeduplicateVertices(const void* vertices,
+                           size_t vertex_count,
+                           size_t vertex_size,
+                           void* unique,
+                           unsigned* indices);
+
+// Reorders triangles so that consecutive ones reuse vertices still in the
+// post-transform cache, with the Tipsify algorithm (Sander, Nehab and
+// Barczak, 2007). Winding is preserved. |destination| may be |indices|.
+void OptimizeVertexCache(unsigned* destination,
+                         const unsigned* indices,
+                         size_t index_count,
+                         size_t vertex_count,
+                         unsigned cache_size);
+
+// Moves vertices into the order the indices first reference them, so the
+// vertex fetch walks memory linearly, and renumbers |indices| to match.
+// Vertices no index refers to are dropped; returns the new vertex count.
+// |destination| may be |vertices|.
+size_t OptimizeVertexFetch(void* destination,
+                           unsigned* indices,
+                           size_t index_count,
+                           const void* vertices,
+                           size_t vertex_count,
+                           size_t vertex_size);
+
+// Average number of vertices transformed per triangle with a FIFO cache of
+// |cache_size| entries: 3 is no reuse at all, 0.5 the limit for a regular
+// grid.
+float AverageCacheMissRatio(const unsigned* indices,
+                            size_t index_count,
+                            unsigned cache_size);
+
+// IEEE half float, rounded to nearest even, for GL_HALF_FLOAT attributes.
+uint16_t QuantizeHalf(float v);
+// [0, 1] to an unsigned normalized byte, for GL_UNSIGNED_BYTE attributes
+// with normalized set. Values outside the range are clamped.
+uint8_t QuantizeUnorm8(float v);
+
+}  // namespace ged
+
+#endif  // GED_MESH_OPTIMIZER_H
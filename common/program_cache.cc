@@ -0,0 +1,278 @@
+#include "program_cache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+
+#include <vector>
+
+namespace {
+
+// Identifies the file layout: magic, binary format, binary length, binary.
+const uint32_t kFileMagic = 0x31485047;  // "GPH1"
+
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+  // 64-bit FNV-1a.
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t hash_string(uint64_t hash, const char* s) {
+  // Include the terminator so that "ab" + "c" and "a" + "bc" differ.
+  return s ? hash_bytes(hash, s, strlen(s) + 1) : hash_bytes(hash, "", 1);
+}
+
+GLuint compile_shader(const char* source, GLenum shader_type) {
+  GLuint shader = glCreateShader(shader_type);
+  assert(shader != 0);
+
+  glShaderSource(shader, 1, (const char**)&source, NULL);
+  glCompileShader(shader);
+  return shader;
+}
+
+// Exits with the info log if |shader| failed to compile. Blocks until the
+// compile is done.
+void check_shader(GLuint shader, GLenum shader_type) {
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    char log[1000];
+    GLsizei len;
+    glGetShaderInfoLog(shader, 1000, &len, log);
+    fprintf(stderr, "Error: compiling %s: %*s\n",
+            shader_type == GL_VERTEX_SHADER ? "vertex" : "fragment", len, log);
+    exit(1);
+  }
+}
+
+// Creates |path| and its parents, like mkdir -p.
+bool make_directories(const std::string& path) {
+  for (size_t i = 1; i <= path.size(); i++) {
+    if (i < path.size() && path[i] != '/')
+      continue;
+    std::string dir = path.substr(0, i);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+ProgramCache::ProgramCache()
+    : enabled_(false),
+      parallel_compile_(false),
+      driver_hash_(0),
+      hits_(0),
+      misses_(0) {}
+
+void ProgramCache::init(bool gles3) {
+  const char* extensions =
+      reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
+  parallel_compile_ =
+      extensions && strstr(extensions, "GL_KHR_parallel_shader_compile");
+  if (parallel_compile_) {
+    // Let the driver use as many compiler threads as it likes.
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads =
+        reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+            eglGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+    if (max_threads)
+      max_threads(0xffffffff);
+  }
+
+  enabled_ = false;
+  if (!gles3)
+    return;
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  if (formats <= 0)
+    return;
+
+  const char* cache_home = getenv("XDG_CACHE_HOME");
+  if (cache_home && cache_home[0] == '/') {
+    directory_ = cache_home;
+  } else {
+    const char* home = getenv("HOME");
+    if (!home)
+      return;
+    directory_ = std::string(home) + "/.cache";
+  }
+  directory_ += "/opengl-wayland";
+
+  driver_hash_ = 14695981039346656037ull;
+  const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION,
+                            GL_SHADING_LANGUAGE_VERSION};
+  for (GLenum name : strings) {
+    driver_hash_ = hash_string(
+        driver_hash_, reinterpret_cast<const char*>(glGetString(name)));
+  }
+  enabled_ = true;
+}
+
+uint64_t ProgramCache::hash_program(const char* vertShaderText,
+                                    const char* fragShaderText,
+                                    const AttribBinding* bindings,
+                                    int binding_count) const {
+  uint64_t hash = hash_string(driver_hash_, vertShaderText);
+  hash = hash_string(hash, fragShaderText);
+  for (int i = 0; i < binding_count; i++) {
+    hash = hash_bytes(hash, &bindings[i].index, sizeof(bindings[i].index));
+    hash = hash_string(hash, bindings[i].name);
+  }
+  return hash;
+}
+
+std::string ProgramCache::path_for(uint64_t hash) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.bin",
+           static_cast<unsigned long long>(hash));
+  return directory_ + name;
+}
+
+GLuint ProgramCache::load_program(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file)
+    return 0;
+
+  uint32_t header[3];
+  std::vector<char> binary;
+  bool ok = fread(header, sizeof(header), 1, file) == 1 &&
+            header[0] == kFileMagic && header[2] > 0;
+  if (ok) {
+    binary.resize(header[2]);
+    ok = fread(binary.data(), binary.size(), 1, file) == 1;
+  }
+  fclose(file);
+  if (!ok)
+    return 0;
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header[1], binary.data(), binary.size());
+  GLint status = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    // Usually a driver update the version string did not reveal.
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void ProgramCache::store_program(GLuint program, const std::string& path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+
+  std::vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+  if (length <= 0 || !make_directories(directory_))
+    return;
+
+  // Write to a temporary name and rename, so a concurrent launch never
+  // reads a partial file.
+  std::string temp = path + "." + std::to_string(getpid());
+  FILE* file = fopen(temp.c_str(), "wb");
+  if (!file)
+    return;
+  uint32_t header[3] = {kFileMagic, format, static_cast<uint32_t>(length)};
+  bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+            fwrite(binary.data(), length, 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp.c_str(), path.c_str()) != 0)
+    unlink(temp.c_str());
+}
+
+ProgramCache::Pending ProgramCache::begin_program(
+    const char* vertShaderText,
+    const char* fragShaderText,
+    const AttribBinding* bindings,
+    int binding_count) {
+  Pending pending = {};
+  if (enabled_) {
+    pending.path = path_for(hash_program(vertShaderText, fragShaderText,
+                                         bindings, binding_count));
+    pending.program = load_program(pending.path);
+    if (pending.program) {
+      hits_++;
+      return pending;
+    }
+    misses_++;
+  }
+
+  pending.frag = compile_shader(fragShaderText, GL_FRAGMENT_SHADER);
+  pending.vert = compile_shader(vertShaderText, GL_VERTEX_SHADER);
+
+  GLuint program = glCreateProgram();
+  glAttachShader(program, pending.frag);
+  glAttachShader(program, pending.vert);
+  // Locations have to be bound before the link that uses them.
+  for (int i = 0; i < binding_count; i++)
+    glBindAttribLocation(program, bindings[i].index, bindings[i].name);
+  if (enabled_)
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  // Linking does not wait for the compiles; a failed one fails the link,
+  // and finish_program() reports it.
+  glLinkProgram(program);
+  pending.program = program;
+  return pending;
+}
+
+bool ProgramCache::ready(const Pending& pending) const {
+  if (!parallel_compile_ || !pending.vert)
+    return true;
+  GLint done = GL_FALSE;
+  glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
+
+GLuint ProgramCache::finish_program(Pending* pending) {
+  GLuint program = pending->program;
+  if (!pending->vert)
+    return program;
+
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    check_shader(pending->frag, GL_FRAGMENT_SHADER);
+    check_shader(pending->vert, GL_VERTEX_SHADER);
+    char log[1000];
+    GLsizei len;
+    glGetProgramInfoLog(program, 1000, &len, log);
+    fprintf(stderr, "Error: linking:\n%*s\n", len, log);
+    exit(1);
+  }
+
+  // The program keeps what it needs; the shaders go once it is deleted.
+  glDeleteShader(pending->frag);
+  glDeleteShader(pending->vert);
+  pending->frag = pending->vert = 0;
+
+  if (enabled_)
+    store_program(program, pending->path);
+  return program;
+}
+
+GLuint ProgramCache::create_program(const char* vertShaderText,
+                                    const char* fragShaderText,
+                                    const AttribBinding* bindings,
+                                    int binding_count) {
+  Pending pending =
+      begin_program(vertShaderText, fragShaderText, bindings, binding_count);
+  return finish_program(&pending);
+}
@@ -0,0 +1,84 @@
+#ifndef OPENGL_WAYLAND_PROGRAM_CACHE_H_
+#define OPENGL_WAYLAND_PROGRAM_CACHE_H_
+
+#include <GLES2/gl2.h>
+
+#include <stdint.h>
+
+#include <string>
+
+// Attribute location bound before the program is linked.
+struct AttribBinding {
+  GLuint index;
+  const char* name;
+};
+
+// Builds linked programs from shader source, keeping the driver's program
+// binaries on disk so later launches skip compiling and linking.
+//
+// Binaries live in $XDG_CACHE_HOME/opengl-wayland, or ~/.cache/opengl-wayland,
+// one file per program. The file name is a hash of the sources, the
+// attribute bindings and the GL vendor, renderer and version strings, so a
+// driver update or a shader edit simply misses the cache. A binary the
+// driver rejects is replaced by compiling from source.
+class ProgramCache {
+ public:
+  ProgramCache();
+
+  // Must be called with the context current. Without OpenGL ES 3, or a
+  // driver that offers no binary formats, every program is compiled.
+  void init(bool gles3);
+
+  // A program whose compile and link have been submitted but not checked.
+  struct Pending {
+    GLuint program;
+    // 0 once checked, or for a program loaded from the cache.
+    GLuint vert;
+    GLuint frag;
+    std::string path;
+  };
+
+  // Returns a linked program, or exits with the compile or link log.
+  GLuint create_program(const char* vertShaderText,
+                        const char* fragShaderText,
+                        const AttribBinding* bindings,
+                        int binding_count);
+
+  // create_program() in two steps, so that the driver can compile while
+  // the caller does other work. begin_program() submits the compile and
+  // link without querying any status. ready() tells whether
+  // finish_program() would return without blocking; it only knows with
+  // GL_KHR_parallel_shader_compile and is always true otherwise.
+  // finish_program() checks the result like create_program().
+  Pending begin_program(const char* vertShaderText,
+                        const char* fragShaderText,
+                        const AttribBinding* bindings,
+                        int binding_count);
+  bool ready(const Pending& pending) const;
+  GLuint finish_program(Pending* pending);
+
+  // Whether the driver compiles in the background and reports progress.
+  bool parallel_compile() const { return parallel_compile_; }
+
+  unsigned hits() const { return hits_; }
+  unsigned misses() const { return misses_; }
+
+ private:
+  uint64_t hash_program(const char* vertShaderText,
+                        const char* fragShaderText,
+                        const AttribBinding* bindings,
+                        int binding_count) const;
+  std::string path_for(uint64_t hash) const;
+  GLuint load_program(const std::string& path);
+  void store_program(GLuint program, const std::string& path);
+
+  bool enabled_;
+  bool parallel_compile_;
+  // Hash of the driver strings, the seed of every program hash.
+  uint64_t driver_hash_;
+  std::string directory_;
+  unsigned hits_;
+  unsigned misses_;
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include "quaternion.h"
+
+#include <math.h>
+
+#include "matrix.h"
+#include "simd.h"
+
+namespace ged {
+
+using namespace simd;
+
+namespace {
+
+const float kDegreesToRadians = static_cast<float>(M_PI / 180.0);
+
+// Past this cosine the arc is too short for a stable slerp.
+const float kSlerpThreshold = 0.9995f;
+
+void NlerpWeights(float dot, float t, float* wa, float* wb) {
+  *wa = 1.0f - t;
+  *wb = dot < 0.0f ? -t : t;
+}
+
+// Returns whether the blended result still needs normalizing.
+bool SlerpWeights(float dot, float t, float* wa, float* wb) {
+  float sign = dot < 0.0f ? -1.0f : 1.0f;
+  dot *= sign;
+  if (dot > kSlerpThreshold) {
+    NlerpWeights(sign, t, wa, wb);
+    return true;
+  }
+  float theta = acosf(dot);
+  float sin_theta = sinf(theta);
+  *wa = sinf((1.0f - t) * theta) / sin_theta;
+  *wb = sign * sinf(t * theta) / sin_theta;
+  return false;
+}
+
+Quaternion Blend(const Quaternion& a, const Quaternion& b, float wa, float wb) {
+  return Quaternion(a.x * wa + b.x * wb, a.y * wa + b.y * wb,
+                    a.z * wa + b.z * wb, a.w * wa + b.w * wb);
+}
+
+struct Lanes {
+  Float4 x, y, z, w;
+};
+
+inline Lanes LoadLanes(ConstQuaternionArrays q, size_t i) {
+  Lanes l = {LoadU(q.x + i), LoadU(q.y + i), LoadU(q.z + i), LoadU(q.w + i)};
+  return l;
+}
+
+inline void StoreLanes(QuaternionArrays q, size_t i, const Lanes& l) {
+  StoreU(q.x + i, l.x);
+  StoreU(q.y + i, l.y);
+  StoreU(q.z + i, l.z);
+  StoreU(q.w + i, l.w);
+}
+
+inline Float4 DotLanes(const Lanes& a, const Lanes& b) {
+  Float4 d = Mul(a.x, b.x);
+  d = MulAdd(a.y, b.y, d);
+  d = MulAdd(a.z, b.z, d);
+  return MulAdd(a.w, b.w, d);
+}
+
+inline Lanes BlendLanes(const Lanes& a, const Lanes& b, Float4 wa, Float4 wb) {
+  Lanes r = {Add(Mul(a.x, wa), Mul(b.x, wb)), Add(Mul(a.y, wa), Mul(b.y, wb)),
+             Add(Mul(a.z, wa), Mul(b.z, wb)), Add(Mul(a.w, wa), Mul(b.w, wb))};
+  return r;
+}
+
+inline Lanes DivideLanes(const Lanes& a, Float4 d) {
+  Lanes r = {Div(a.x, d), Div(a.y, d), Div(a.z, d), Div(a.w, d)};
+  return r;
+}
+
+// Normalizes the lanes marked in |normalize| as Quaternion::Normalize()
+// does. The others, and those of length 0, are divided by one, which is
+// exact.
+inline Lanes NormalizeLanes(const Lanes& a, const bool normalize[4]) {
+  alignas(16) float len[4];
+  Store(len, Sqrt(DotLanes(a, a)));
+  for (int l = 0; l < 4; l++) {
+    if (!normalize[l] || !(len[l] > 0.0f))
+      len[l] = 1.0f;
+  }
+  return DivideLanes(a, Load(len));
+}
+
+Quaternion At(ConstQuaternionArrays q, size_t i) {
+  return Quaternion(q.x[i], q.y[i], q.z[i], q.w[i]);
+}
+
+void Put(QuaternionArrays q, size_t i, const Quaternion& v) {
+  q.x[i] = v.x;
+  q.y[i] = v.y;
+  q.z[i] = v.z;
+  q.w[i] = v.w;
+}
+
+}  // namespace
+
+Quaternion Quaternion::FromAxisAngle(float angle, float x, float y, float z) {
+  float mag = sqrtf(x * x + y * y + z * z);
+  if (mag <= 0.0f)
+    return Quaternion();
+  float half = angle * (0.5f * kDegreesToRadians);
+  float s = sinf(half) / mag;
+  return Quaternion(x * s, y * s, z * s, cosf(half));
+}
+
+Quaternion Quaternion::operator*(const Quaternion& q) const {
+  return Quaternion(w * q.x + x * q.w + y * q.z - z * q.y,
+                    w * q.y - x * q.z + y * q.w + z * q.x,
+                    w * q.z + x * q.y - y * q.x + z * q.w,
+                    w * q.w - x * q.x - y * q.y - z * q.z);
+}
+
+float Quaternion::Dot(const Quaternion& q) const {
+  return x * q.x + y * q.y + z * q.z + w * q.w;
+}
+
+void Quaternion::Normalize() {
+  float len = sqrtf(Dot(*this));
+  if (len > 0.0f) {
+    x /= len;
+    y /= len;
+    z /= len;
+    w /= len;
+  }
+}
+
+Quaternion Quaternion::Nlerp(const Quaternion& a,
+                             const Quaternion& b,
+                             float t) {
+  float wa, wb;
+  NlerpWeights(a.Dot(b), t, &wa, &wb);
+  Quaternion r = Blend(a, b, wa, wb);
+  r.Normalize();
+  return r;
+}
+
+Quaternion Quaternion::Slerp(const Quaternion& a,
+                             const Quaternion& b,
+                             float t) {
+  float wa, wb;
+  bool normalize = SlerpWeights(a.Dot(b), t, &wa, &wb);
+  Quaternion r = Blend(a, b, wa, wb);
+  if (normalize)
+    r.Normalize();
+  return r;
+}
+
+void Quaternion::To3x3(float rot[3][3]) const {
+  float xx = x * x, yy = y * y, zz = z * z;
+  float xy = x * y, xz = x * z, yz = y * z;
+  float wx = w * x, wy = w * y, wz = w * z;
+
+  rot[0][0] = 1.0f - 2.0f * (yy + zz);
+  rot[0][1] = 2.0f * (xy - wz);
+  rot[0][2] = 2.0f * (xz + wy);
+
+  rot[1][0] = 2.0f * (xy + wz);
+  rot[1][1] = 1.0f - 2.0f * (xx + zz);
+  rot[1][2] = 2.0f * (yz - wx);
+
+  rot[2][0] = 2.0f * (xz - wy);
+  rot[2][1] = 2.0f * (yz + wx);
+  rot[2][2] = 1.0f - 2.0f * (xx + yy);
+}
+
+void Quaternion::ToMatrix(Matrix* m) const {
+  *m = Matrix();
+  m->Rotate(*this);
+}
+
+DualQuaternion DualQuaternion::FromRotationTranslation(
+    const Quaternion& rotation,
+    float tx,
+    float ty,
+    float tz) {
+  // dual = -1/2 * rotation * t, with t as a pure quaternion. The sign and
+  // order follow from the row vector convention of Matrix.
+  Quaternion d = rotation * Quaternion(tx, ty, tz, 0.0f);
+  return DualQuaternion(rotation, Quaternion(-0.5f * d.x, -0.5f * d.y,
+                                             -0.5f * d.z, -0.5f * d.w));
+}
+
+DualQuaternion DualQuaternion::operator*(const DualQuaternion& q) const {
+  Quaternion a = real * q.dual;
+  Quaternion b = dual * q.real;
+  return DualQuaternion(real * q.real,
+                        Quaternion(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w));
+}
+
+void DualQuaternion::Normalize() {
+  float len = sqrtf(real.Dot(real));
+  if (len <= 0.0f)
+    return;
+  real = Quaternion(real.x / len, real.y / len, real.z / len, real.w / len);
+  dual = Quaternion(dual.x / len, dual.y / len, dual.z / len, dual.w / len);
+}
+
+void DualQuaternion::GetTranslation(float* tx, float* ty, float* tz) const {
+  Quaternion t = real.Conjugate() * dual;
+  *tx = -2.0f * t.x;
+  *ty = -2.0f * t.y;
+  *tz = -2.0f * t.z;
+}
+
+DualQuaternion DualQuaternion::Blend(const DualQuaternion& a,
+                                     const DualQuaternion& b,
+                                     float t) {
+  float wa, wb;
+  NlerpWeights(a.real.Dot(b.real), t, &wa, &wb);
+  DualQuaternion r(ged::Blend(a.real, b.real, wa, wb),
+                   ged::Blend(a.dual, b.dual, wa, wb));
+  r.Normalize();
+  return r;
+}
+
+void DualQuaternion::ToMatrix(Matrix* m) const {
+  float tx, ty, tz;
+  GetTranslation(&tx, &ty, &tz);
+  *m = Matrix();
+  m->Translate(tx, ty, tz);
+  m->Rotate(real);
+}
+
+void MultiplyQuaternions(ConstQuaternionArrays a,
+                         ConstQuaternionArrays b,
+                         QuaternionArrays out,
+                         size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    Lanes p = LoadLanes(a, i);
+    Lanes q = LoadLanes(b, i);
+    Lanes r;
+    r.x = Sub(Add(Add(Mul(p.w, q.x), Mul(p.x, q.w)), Mul(p.y, q.z)),
+              Mul(p.z, q.y));
+    r.y = Add(Add(Sub(Mul(p.w, q.y), Mul(p.x, q.z)), Mul(p.y, q.w)),
+              Mul(p.z, q.x));
+    r.z = Add(Sub(Add(Mul(p.w, q.z), Mul(p.x, q.y)), Mul(p.y, q.x)),
+              Mul(p.z, q.w));
+    r.w = Sub(Sub(Sub(Mul(p.w, q.w), Mul(p.x, q.x)), Mul(p.y, q.y)),
+              Mul(p.z, q.z));
+    StoreLanes(out, i, r);
+  }
+  for (; i < count; i++)
+    Put(out, i, At(a, i) * At(b, i));
+}
+
+void NlerpQuaternions(ConstQuaternionArrays a,
+                      ConstQuaternionArrays b,
+                      float t,
+                      QuaternionArrays out,
+                      size_t count) {
+  static const bool kAll[4] = {true, true, true, true};
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    Lanes p = LoadLanes(a, i);
+    Lanes q = LoadLanes(b, i);
+    alignas(16) float dot[4];
+    Store(dot, DotLanes(p, q));
+    float wa, wb[4];
+    for (int l = 0; l < 4; l++)
+      NlerpWeights(dot[l], t, &wa, &wb[l]);
+    Lanes r = BlendLanes(p, q, Splat(wa), LoadU(wb));
+    StoreLanes(out, i, NormalizeLanes(r, kAll));
+  }
+  for (; i < count; i++)
+    Put(out, i, Quaternion::Nlerp(At(a, i), At(b, i), t));
+}
+
+void SlerpQuaternions(ConstQuaternionArrays a,
+                      ConstQuaternionArrays b,
+                      float t,
+                      QuaternionArrays out,
+                      size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    Lanes p = LoadLanes(a, i);
+    Lanes q = LoadLanes(b, i);
+    alignas(16) float dot[4];
+    Store(dot, DotLanes(p, q));
+    float wa[4], wb[4];
+    bool normalize[4];
+    for (int l = 0; l < 4; l++)
+      normalize[l] = SlerpWeights(dot[l], t, &wa[l], &wb[l]);
+    // Lanes that took the slerp path are left as they are.
+    Lanes r = BlendLanes(p, q, LoadU(wa), LoadU(wb));
+    r = NormalizeLanes(r, normalize);
+    StoreLanes(out, i, r);
+  }
+  for (; i < count; i++)
+    Put(out, i, Quaternion::Slerp(At(a, i), At(b, i), t));
+}
+
+}  // namespace ged
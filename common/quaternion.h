@@ -0,0 +1,118 @@
+#ifndef GED_QUATERNION_H
+#define GED_QUATERNION_H
+
+#include <stddef.h>
+
+namespace ged {
+
+class Matrix;
+
+// Unit quaternion rotation, (x, y, z) vector part and w scalar part.
+//
+// Conventions follow Matrix: FromAxisAngle(angle, x, y, z).ToMatrix() is the
+// matrix that Matrix::Rotate(angle, x, y, z) multiplies in, and a * b is the
+// rotation that applies a first and then b, the same order as
+// Matrix(a).MatrixMultiply(Matrix(b)). A chain of Rotate calls
+//
+//   m.Rotate(a1, ...);
+//   m.Rotate(a2, ...);
+//
+// therefore collapses to m.Rotate(q2 * q1).
+class Quaternion {
+ public:
+  Quaternion() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+  Quaternion(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+
+  /// \param angle Rotation angle in degrees
+  /// \param x, y, z Rotation axis, need not be normalized
+  static Quaternion FromAxisAngle(float angle, float x, float y, float z);
+
+  Quaternion operator*(const Quaternion& q) const;
+  Quaternion Conjugate() const { return Quaternion(-x, -y, -z, w); }
+  float Dot(const Quaternion& q) const;
+  void Normalize();
+
+  // Interpolate along the shorter arc. Nlerp is a normalized linear blend,
+  // cheap and good enough for small steps or per-frame animation; Slerp has
+  // constant angular velocity.
+  static Quaternion Nlerp(const Quaternion& a, const Quaternion& b, float t);
+  static Quaternion Slerp(const Quaternion& a, const Quaternion& b, float t);
+
+  // Replaces |m| with the rotation matrix.
+  void ToMatrix(Matrix* m) const;
+  // The 3x3 rotation in the row layout of Matrix.
+  void To3x3(float rot[3][3]) const;
+
+  float x, y, z, w;
+};
+
+// Rigid transform (rotation followed by translation) as a dual quaternion.
+// FromRotationTranslation(q, t).ToMatrix() equals
+//
+//   m.Translate(tx, ty, tz);
+//   m.Rotate(q);
+//
+// on an identity matrix, and products compose in the same order as
+// Quaternion. Unlike matrices, dual quaternions blend without shearing,
+// which makes them suitable for skinning and interpolated rigid motion.
+class DualQuaternion {
+ public:
+  DualQuaternion() : real(), dual(0.0f, 0.0f, 0.0f, 0.0f) {}
+  DualQuaternion(const Quaternion& real, const Quaternion& dual)
+      : real(real), dual(dual) {}
+
+  static DualQuaternion FromRotationTranslation(const Quaternion& rotation,
+                                                float tx,
+                                                float ty,
+                                                float tz);
+
+  DualQuaternion operator*(const DualQuaternion& q) const;
+  void Normalize();
+  void GetTranslation(float* tx, float* ty, float* tz) const;
+
+  // Dual quaternion linear blend, normalized.
+  static DualQuaternion Blend(const DualQuaternion& a,
+                              const DualQuaternion& b,
+                              float t);
+
+  void ToMatrix(Matrix* m) const;
+
+  Quaternion real;
+  Quaternion dual;
+};
+
+// Component arrays of quaternions, as stored in TransformBatch.
+struct QuaternionArrays {
+  float* x;
+  float* y;
+  float* z;
+  float* w;
+};
+
+struct ConstQuaternionArrays {
+  const float* x;
+  const float* y;
+  const float* z;
+  const float* w;
+};
+
+// Batch versions of the operations above, four quaternions per step. The
+// results are bit-identical to the scalar functions. |out| may alias an input.
+void MultiplyQuaternions(ConstQuaternionArrays a,
+                         ConstQuaternionArrays b,
+                         QuaternionArrays out,
+                         size_t count);
+void NlerpQuaternions(ConstQuaternionArrays a,
+                      ConstQuaternionArrays b,
+                      float t,
+                      QuaternionArrays out,
+                      size_t count);
+void SlerpQuaternions(ConstQuaternionArrays a,
+                      ConstQuaternionArrays b,
+                      float t,
+                      QuaternionArrays out,
+                      size_t count);
+
+}  // namespace ged
+
+#endif  // GED_QUATERNION_H
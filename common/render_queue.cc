@@ -0,0 +1,183 @@
+#include "render_queue.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "gl.h"
+
+namespace {
+
+int uniform_floats(GLenum type) {
+  switch (type) {
+    case GL_FLOAT:
+    case GL_INT:
+      return 1;
+    case GL_FLOAT_VEC2:
+      return 2;
+    case GL_FLOAT_VEC3:
+      return 3;
+    case GL_FLOAT_VEC4:
+      return 4;
+    case GL_FLOAT_MAT4:
+      return 16;
+    default:
+      assert(!"unsupported uniform type");
+      return 0;
+  }
+}
+
+}  // namespace
+
+RenderQueue::RenderQueue()
+    : item_count_(0), uniform_count_(0), dropped_(0), sorted_(false) {}
+
+void RenderQueue::init(size_t max_draws, size_t max_uniforms) {
+  items_.resize(max_draws);
+  uniforms_.resize(max_uniforms);
+  order_.resize(max_draws);
+  scratch_.resize(max_draws);
+  clear();
+}
+
+uint64_t RenderQueue::make_key(const Draw& draw) {
+  // The bit pattern of a non-negative float grows with its value, so the
+  // top 24 bits order depths well enough.
+  float depth = draw.depth > 0.0f ? draw.depth : 0.0f;
+  uint32_t depth_bits;
+  memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+  return (static_cast<uint64_t>(draw.target & 0xff) << 56) |
+         (static_cast<uint64_t>(draw.program & 0xffff) << 40) |
+         (static_cast<uint64_t>(draw.texture & 0xffff) << 24) |
+         (depth_bits >> 8);
+}
+
+bool RenderQueue::record(const Draw& draw) {
+  size_t first_uniform = 0;
+  if (draw.uniform_count) {
+    first_uniform = uniform_count_.fetch_add(draw.uniform_count,
+                                             std::memory_order_relaxed);
+    if (first_uniform + draw.uniform_count > uniforms_.size()) {
+      dropped_++;
+      return false;
+    }
+  }
+  size_t index = item_count_.fetch_add(1, std::memory_order_relaxed);
+  if (index >= items_.size()) {
+    dropped_++;
+    return false;
+  }
+
+  for (int i = 0; i < draw.uniform_count; i++) {
+    const UniformValue& in = draw.uniforms[i];
+    Uniform& out = uniforms_[first_uniform + i];
+    out.location = in.location;
+    out.type = in.type;
+    memcpy(out.value, in.value, uniform_floats(in.type) * sizeof(GLfloat));
+  }
+
+  Item& item = items_[index];
+  item.program = draw.program;
+  item.mesh = draw.mesh;
+  item.mode = draw.mode;
+  item.texture = draw.texture;
+  item.first_uniform = first_uniform;
+  item.uniform_count = draw.uniform_count;
+  order_[index].key = make_key(draw);
+  order_[index].item = index;
+  return true;
+}
+
+size_t RenderQueue::size() const {
+  return std::min(item_count_.load(std::memory_order_relaxed), items_.size());
+}
+
+void RenderQueue::sort() {
+  size_t count = size();
+  SortEntry* in = order_.data();
+  SortEntry* out = scratch_.data();
+
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t histogram[256] = {};
+    for (size_t i = 0; i < count; i++)
+      histogram[(in[i].key >> shift) & 0xff]++;
+    // Every key has the same byte here, so the pass would not move anything.
+    if (count == 0 || histogram[(in[0].key >> shift) & 0xff] == count)
+      continue;
+
+    size_t offset = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t n = histogram[b];
+      histogram[b] = offset;
+      offset += n;
+    }
+    for (size_t i = 0; i < count; i++)
+      out[histogram[(in[i].key >> shift) & 0xff]++] = in[i];
+    std::swap(in, out);
+  }
+
+  if (in != order_.data())
+    memcpy(order_.data(), in, count * sizeof(SortEntry));
+  sorted_ = true;
+}
+
+void RenderQueue::set_uniform(const Uniform& uniform) {
+  switch (uniform.type) {
+    case GL_FLOAT:
+      glUniform1fv(uniform.location, 1, uniform.value);
+      break;
+    case GL_FLOAT_VEC2:
+      glUniform2fv(uniform.location, 1, uniform.value);
+      break;
+    case GL_FLOAT_VEC3:
+      glUniform3fv(uniform.location, 1, uniform.value);
+      break;
+    case GL_FLOAT_VEC4:
+      glUniform4fv(uniform.location, 1, uniform.value);
+      break;
+    case GL_FLOAT_MAT4:
+      glUniformMatrix4fv(uniform.location, 1, GL_FALSE, uniform.value);
+      break;
+    case GL_INT: {
+      GLint value;
+      memcpy(&value, uniform.value, sizeof(value));
+      glUniform1i(uniform.location, value);
+      break;
+    }
+  }
+}
+
+void RenderQueue::submit(GL* gl) {
+  assert(sorted_ || size() <= 1);
+  size_t count = size();
+  for (size_t i = 0; i < count; i++) {
+    const Item& item = items_[order_[i].item];
+    // Each of these does nothing when the state is already set.
+    gl->shaders.use(item.program);
+    if (item.texture) {
+      gl->state.active_texture(GL_TEXTURE0);
+      gl->state.bind_texture(GL_TEXTURE_2D, item.texture);
+    }
+    for (unsigned u = 0; u < item.uniform_count; u++)
+      set_uniform(uniforms_[item.first_uniform + u]);
+    gl->meshes.draw(item.mesh, item.mode);
+  }
+}
+
+void RenderQueue::clear() {
+  item_count_.store(0, std::memory_order_relaxed);
+  uniform_count_.store(0, std::memory_order_relaxed);
+  sorted_ = false;
+}
+
+void RenderQueue::flush(GL* gl) {
+  if (!size()) {
+    clear();
+    return;
+  }
+  sort();
+  submit(gl);
+  clear();
+}
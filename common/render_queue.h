@@ -0,0 +1,106 @@
+#ifndef OPENGL_WAYLAND_RENDER_QUEUE_H_
+#define OPENGL_WAYLAND_RENDER_QUEUE_H_
+
+#include <GLES2/gl2.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "mesh.h"
+#include "shader_manager.h"
+
+class GL;
+
+// A uniform value recorded with a draw. |type| is GL_FLOAT, GL_FLOAT_VEC2,
+// GL_FLOAT_VEC3, GL_FLOAT_VEC4, GL_FLOAT_MAT4 or GL_INT, and |value| points
+// to that many floats, or one GLint.
+struct UniformValue {
+  GLint location;
+  GLenum type;
+  const void* value;
+};
+
+// Records draws into preallocated storage and replays them sorted, so that
+// draws sharing a target, a program and a texture run back to back and each
+// piece of state is set once.
+//
+// record() may be called from any number of threads at once: a draw and
+// its uniforms are copied into slots claimed with an atomic add, and
+// nothing is allocated. sort(), submit() and clear() run on the thread
+// that owns the context, after the recording threads are done.
+//
+// Draws are ordered by a 64-bit key: target (8 bits), program (16),
+// texture (16), then depth (24) front to back.
+class RenderQueue {
+ public:
+  struct Draw {
+    // Render pass, lowest first; 0 to 255.
+    unsigned target;
+    ProgramHandle program;
+    MeshHandle mesh;
+    GLenum mode;
+    // Bound to texture unit 0 as GL_TEXTURE_2D, unless 0.
+    GLuint texture;
+    // Distance from the camera, not negative.
+    float depth;
+    const UniformValue* uniforms;
+    int uniform_count;
+  };
+
+  RenderQueue();
+
+  void init(size_t max_draws, size_t max_uniforms);
+
+  // Returns false, and drops the draw, when the queue is full.
+  bool record(const Draw& draw);
+
+  // Sorts the recorded draws by key with an LSD radix sort.
+  void sort();
+  // Replays the draws in sorted order.
+  void submit(GL* gl);
+  void clear();
+  // sort(), submit() and clear().
+  void flush(GL* gl);
+
+  size_t size() const;
+  // Draws dropped because the queue was full, since init().
+  unsigned dropped() const { return dropped_.load(); }
+
+ private:
+  static const int kMaxUniformFloats = 16;
+
+  struct Uniform {
+    GLint location;
+    GLenum type;
+    GLfloat value[kMaxUniformFloats];
+  };
+
+  struct Item {
+    ProgramHandle program;
+    MeshHandle mesh;
+    GLenum mode;
+    GLuint texture;
+    unsigned first_uniform;
+    unsigned uniform_count;
+  };
+
+  struct SortEntry {
+    uint64_t key;
+    uint32_t item;
+  };
+
+  static uint64_t make_key(const Draw& draw);
+  static void set_uniform(const Uniform& uniform);
+
+  std::vector<Item> items_;
+  std::vector<Uniform> uniforms_;
+  std::vector<SortEntry> order_;
+  std::vector<SortEntry> scratch_;
+  std::atomic<size_t> item_count_;
+  std::atomic<size_t> uniform_count_;
+  std::atomic<unsigned> dropped_;
+  bool sorted_;
+};
+
+#endif
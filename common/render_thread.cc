@@ -0,0 +1,144 @@
+#include "render_thread.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "gl.h"
+#include "trace.h"
+#include "window.h"
+
+// Same as the queue GL replays after drawPtr.
+static const size_t kMaxFrameDraws = 4096;
+static const size_t kMaxFrameUniforms = 8192;
+
+RenderThread::RenderThread()
+    : window_(nullptr),
+      gl_(nullptr),
+      jobs_(nullptr),
+      frame_requested_(false),
+      frame_pending_(false),
+      quit_(false),
+      update_queue_(nullptr),
+      front_(0) {}
+
+RenderThread::~RenderThread() {
+  stop();
+}
+
+void RenderThread::start(WaylandWindow* window, GL* gl, JobSystem* jobs) {
+  assert(!started());
+  window_ = window;
+  gl_ = gl;
+  jobs_ = jobs;
+  quit_ = false;
+
+  // A context can only be current on one thread at a time.
+  WaylandDisplay* display = window->display;
+  eglMakeCurrent(display->egl.dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+
+  if (window->updatePtr) {
+    frames_[0].init(kMaxFrameDraws, kMaxFrameUniforms);
+    frames_[1].init(kMaxFrameDraws, kMaxFrameUniforms);
+  }
+  render_thread_ = std::thread(&RenderThread::render_main, this);
+}
+
+void RenderThread::stop() {
+  if (!started())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  cond_.notify_one();
+  render_thread_.join();
+
+  WaylandDisplay* display = window_->display;
+  EGLBoolean ret = eglMakeCurrent(display->egl.dpy, window_->egl_surface,
+                                  window_->egl_surface, display->egl.ctx);
+  assert(ret == EGL_TRUE);
+}
+
+void RenderThread::request_frame() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_requested_ = true;
+    frame_pending_ = true;
+  }
+  cond_.notify_one();
+}
+
+bool RenderThread::frame_pending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frame_pending_;
+}
+
+bool RenderThread::wait_for_frame() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this] { return frame_requested_ || quit_; });
+  frame_requested_ = false;
+  return !quit_;
+}
+
+void RenderThread::update(void* data, size_t begin, size_t end) {
+  TRACE_SCOPE("update");
+  RenderThread* self = static_cast<RenderThread*>(data);
+  self->window_->updatePtr(self->window_, self->update_queue_);
+}
+
+void RenderThread::begin_update(RenderQueue* queue) {
+  assert(update_done_.done());
+  update_queue_ = queue;
+  window_->clock.tick();
+  jobs_->run(&RenderThread::update, this, 0, 0, &update_done_);
+}
+
+// Runs other jobs, such as the update's own, while it waits.
+void RenderThread::wait_update() {
+  TRACE_SCOPE("wait update");
+  jobs_->wait(&update_done_);
+}
+
+void RenderThread::render_main() {
+  TRACE_THREAD_NAME("render");
+  WaylandDisplay* display = window_->display;
+  EGLBoolean ret = eglMakeCurrent(display->egl.dpy, window_->egl_surface,
+                                  window_->egl_surface, display->egl.ctx);
+  assert(ret == EGL_TRUE);
+
+  // The first frame waits for its update; after that, each frame's update
+  // overlaps drawing the one before it.
+  bool update = window_->updatePtr != nullptr;
+  if (update)
+    begin_update(&frames_[front_ ^ 1]);
+
+  while (wait_for_frame()) {
+    // Start as late as still makes the next vblank, so the frame shows
+    // the newest state. Mailbox mode draws as fast as it can instead.
+    if (window_->present_mode != kPresentMailbox) {
+      TRACE_SCOPE("deadline");
+      window_->scheduler.wait_for_deadline();
+    }
+
+    RenderQueue* frame = nullptr;
+    if (update) {
+      wait_update();
+      front_ ^= 1;
+      begin_update(&frames_[front_ ^ 1]);
+      frame = &frames_[front_];
+    }
+    window_->draw_frame(frame);
+
+    // The frame callback is set by now. A request that came in meanwhile,
+    // from that callback say, is still pending.
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_pending_ = frame_requested_;
+  }
+
+  if (update)
+    wait_update();
+  eglMakeCurrent(display->egl.dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+}
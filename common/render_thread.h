@@ -0,0 +1,71 @@
+#ifndef OPENGL_WAYLAND_RENDER_THREAD_H_
+#define OPENGL_WAYLAND_RENDER_THREAD_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "job_system.h"
+#include "render_queue.h"
+
+class GL;
+class WaylandWindow;
+
+// Draws a window on its own thread, which owns the EGL context, so that the
+// thread dispatching Wayland events never waits for a frame.
+//
+// The event thread only calls request_frame() when a frame callback comes
+// in. If the window has an updatePtr, the scene update runs as a job on
+// the pool and records into one of two frame queues while the render
+// thread replays the other, so a frame takes about max(update, render) rather than
+// their sum, at the cost of one frame of latency.
+class RenderThread {
+ public:
+  RenderThread();
+  ~RenderThread();
+
+  // Releases the context from the calling thread and starts drawing
+  // |window| on a new thread.
+  void start(WaylandWindow* window, GL* gl, JobSystem* jobs);
+  // Joins the thread and makes the context current on the calling thread
+  // again.
+  void stop();
+  bool started() const { return render_thread_.joinable(); }
+
+  // Called on the event thread.
+  void request_frame();
+  // Whether a frame was requested and has not been drawn yet. Until it is,
+  // the window may have no frame callback even though one is coming.
+  bool frame_pending();
+
+ private:
+  void render_main();
+  static void update(void* data, size_t begin, size_t end);
+  // Returns false once stop() was called.
+  bool wait_for_frame();
+  void begin_update(RenderQueue* queue);
+  void wait_update();
+
+  WaylandWindow* window_;
+  GL* gl_;
+  JobSystem* jobs_;
+  std::thread render_thread_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool frame_requested_;
+  // Set from request_frame() until draw_frame() returns with no other
+  // frame requested.
+  bool frame_pending_;
+  bool quit_;
+
+  JobCounter update_done_;
+  RenderQueue* update_queue_;  // Being recorded by the update job.
+
+  // The render thread replays frames_[front_] while the update job records
+  // the other.
+  RenderQueue frames_[2];
+  int front_;
+};
+
+#endif
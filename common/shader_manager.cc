@@ -0,0 +1,277 @@
+#include "shader_manager.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+ShaderManager::ShaderManager()
+    : cache_(nullptr),
+      current_(0),
+      program_switches_(0),
+      wait_milliseconds_(0.0),
+      display_(EGL_NO_DISPLAY),
+      worker_context_(EGL_NO_CONTEXT),
+      next_job_(0),
+      stop_(false) {}
+
+ShaderManager::~ShaderManager() {
+  stop_worker();
+}
+
+void ShaderManager::init(ProgramCache* cache,
+                         EGLDisplay display,
+                         EGLContext worker_context) {
+  cache_ = cache;
+  display_ = display;
+  // The driver's own threads do better than ours.
+  worker_context_ =
+      cache->parallel_compile() ? EGL_NO_CONTEXT : worker_context;
+}
+
+ShaderManager::Program& ShaderManager::get(ProgramHandle program) {
+  assert(program > 0 && program <= programs_.size());
+  return programs_[program - 1];
+}
+
+void ShaderManager::read_locations(GLuint id, bool uniforms) {
+  GLint count = 0;
+  GLint max_length = 0;
+  glGetProgramiv(id, uniforms ? GL_ACTIVE_UNIFORMS : GL_ACTIVE_ATTRIBUTES,
+                 &count);
+  glGetProgramiv(id,
+                 uniforms ? GL_ACTIVE_UNIFORM_MAX_LENGTH
+                          : GL_ACTIVE_ATTRIBUTE_MAX_LENGTH,
+                 &max_length);
+
+  std::vector<char> name(max_length + 1);
+  for (GLint i = 0; i < count; i++) {
+    GLsizei length = 0;
+    GLint size;
+    GLenum type;
+    Location entry;
+    if (uniforms) {
+      glGetActiveUniform(id, i, name.size(), &length, &size, &type,
+                         name.data());
+      entry.location = glGetUniformLocation(id, name.data());
+    } else {
+      glGetActiveAttrib(id, i, name.size(), &length, &size, &type,
+                        name.data());
+      entry.location = glGetAttribLocation(id, name.data());
+    }
+    entry.name.assign(name.data(), length);
+    // Arrays are reported as "name[0]"; keep the plain name.
+    if (entry.name.size() > 3 &&
+        entry.name.compare(entry.name.size() - 3, 3, "[0]") == 0)
+      entry.name.resize(entry.name.size() - 3);
+    (uniforms ? uniforms_ : attribs_).push_back(entry);
+  }
+}
+
+void ShaderManager::read_locations(Program* program) {
+  program->first_uniform = uniforms_.size();
+  read_locations(program->id, true);
+  program->uniform_count = uniforms_.size() - program->first_uniform;
+  program->first_attrib = attribs_.size();
+  read_locations(program->id, false);
+  program->attrib_count = attribs_.size() - program->first_attrib;
+}
+
+ProgramHandle ShaderManager::create_program(const char* vertShaderText,
+                                            const char* fragShaderText,
+                                            const AttribBinding* bindings,
+                                            int binding_count) {
+  ProgramHandle program = create_program_async(vertShaderText, fragShaderText,
+                                               bindings, binding_count);
+  wait(program);
+  return program;
+}
+
+ProgramHandle ShaderManager::create_program_async(
+    const char* vertShaderText,
+    const char* fragShaderText,
+    const AttribBinding* bindings,
+    int binding_count) {
+  assert(cache_);
+  Program program = {};
+  program.pending = true;
+
+  if (worker_context_ != EGL_NO_CONTEXT) {
+    std::unique_ptr<Job> job(new Job());
+    job->vert = vertShaderText;
+    job->frag = fragShaderText;
+    for (int i = 0; i < binding_count; i++) {
+      job->names.push_back(bindings[i].name);
+      job->indices.push_back(bindings[i].index);
+    }
+    program.job = job.get();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+    if (!worker_.joinable())
+      worker_ = std::thread(&ShaderManager::run_worker, this);
+    cond_.notify_all();
+  } else {
+    program.compile = cache_->begin_program(vertShaderText, fragShaderText,
+                                            bindings, binding_count);
+  }
+
+  programs_.push_back(program);
+  return programs_.size();
+}
+
+bool ShaderManager::is_ready(ProgramHandle handle) {
+  Program& program = get(handle);
+  if (!program.pending)
+    return true;
+  if (program.job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return program.job->done;
+  }
+  return cache_->ready(program.compile);
+}
+
+void ShaderManager::wait(ProgramHandle handle) {
+  Program& program = get(handle);
+  if (!program.pending)
+    return;
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  if (program.job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [&program] { return program.job->done; });
+    program.id = program.job->program;
+  } else {
+    program.id = cache_->finish_program(&program.compile);
+  }
+  wait_milliseconds_ += std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+  program.pending = false;
+  program.job = nullptr;
+  read_locations(&program);
+}
+
+void ShaderManager::run_worker() {
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, worker_context_);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cond_.wait(lock, [this] { return stop_ || next_job_ < jobs_.size(); });
+    if (next_job_ == jobs_.size())
+      break;
+    Job* job = jobs_[next_job_++].get();
+    lock.unlock();
+
+    std::vector<AttribBinding> bindings;
+    for (size_t i = 0; i < job->names.size(); i++) {
+      AttribBinding binding = {job->indices[i], job->names[i].c_str()};
+      bindings.push_back(binding);
+    }
+    // The cache is only used from here while the worker runs.
+    GLuint program =
+        cache_->create_program(job->vert.c_str(), job->frag.c_str(),
+                               bindings.data(), bindings.size());
+    // The other context only sees the program once the link completed.
+    glFinish();
+
+    lock.lock();
+    job->program = program;
+    job->done = true;
+    cond_.notify_all();
+  }
+  lock.unlock();
+
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglReleaseThread();
+}
+
+void ShaderManager::stop_worker() {
+  if (!worker_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    cond_.notify_all();
+  }
+  worker_.join();
+}
+
+void ShaderManager::destroy_all() {
+  stop_worker();
+  for (size_t i = 0; i < programs_.size(); i++) {
+    Program& program = programs_[i];
+    if (program.pending && !program.job)
+      program.id = cache_->finish_program(&program.compile);
+    else if (program.job)
+      program.id = program.job->program;
+    glDeleteProgram(program.id);
+  }
+  programs_.clear();
+  uniforms_.clear();
+  attribs_.clear();
+  jobs_.clear();
+  next_job_ = 0;
+  stop_ = false;
+  current_ = 0;
+}
+
+GLint ShaderManager::find(const std::vector<Location>& table,
+                          unsigned first,
+                          unsigned count,
+                          const char* name) {
+  size_t length = strlen(name);
+  if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+    length -= 3;
+  for (unsigned i = first; i < first + count; i++) {
+    if (table[i].name.size() == length &&
+        table[i].name.compare(0, length, name, length) == 0)
+      return table[i].location;
+  }
+  return -1;
+}
+
+GLint ShaderManager::uniform_location(ProgramHandle program,
+                                      const char* name) {
+  wait(program);
+  const Program& p = get(program);
+  return find(uniforms_, p.first_uniform, p.uniform_count, name);
+}
+
+GLint ShaderManager::attrib_location(ProgramHandle program,
+                                     const char* name) {
+  wait(program);
+  const Program& p = get(program);
+  return find(attribs_, p.first_attrib, p.attrib_count, name);
+}
+
+GLuint ShaderManager::program_id(ProgramHandle program) {
+  wait(program);
+  return get(program).id;
+}
+
+void ShaderManager::use(ProgramHandle program) {
+  if (program == current_)
+    return;
+  glUseProgram(program ? program_id(program) : 0);
+  current_ = program;
+  program_switches_++;
+}
+
+void ShaderManager::submit(Draw* draws, int count) {
+  // Start with the current program, which needs no switch.
+  ProgramHandle first = current_;
+  std::stable_sort(draws, draws + count,
+                   [first](const Draw& a, const Draw& b) {
+                     if ((a.program == first) != (b.program == first))
+                       return a.program == first;
+                     return a.program < b.program;
+                   });
+  for (int i = 0; i < count; i++) {
+    use(draws[i].program);
+    draws[i].draw(draws[i].data);
+  }
+}
@@ -0,0 +1,142 @@
+#ifndef OPENGL_WAYLAND_SHADER_MANAGER_H_
+#define OPENGL_WAYLAND_SHADER_MANAGER_H_
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "program_cache.h"
+
+// Handle to a program owned by ShaderManager. 0 is never a valid program.
+typedef unsigned ProgramHandle;
+
+// Owns every linked program of a context. When a program is created its
+// active uniforms and attributes are read once into a flat table, so code
+// that needs a location asks the table at setup time and nothing calls
+// glGetUniformLocation while drawing. use() skips glUseProgram when the
+// program is already current, and submit() groups draws by program.
+//
+// create_program_async() returns before the program is built, so startup
+// work can overlap the compile. With GL_KHR_parallel_shader_compile the
+// driver compiles in the background and is polled. Otherwise, given a
+// context that shares objects with this one, a worker thread compiles
+// with it. Failing both, the compile is merely submitted early. Anything
+// that needs the program, including a location lookup, waits for it.
+class ShaderManager {
+ public:
+  // One draw for submit(): |draw| is called with |data| while |program| is
+  // current.
+  struct Draw {
+    ProgramHandle program;
+    void (*draw)(void* data);
+    void* data;
+  };
+
+  ShaderManager();
+  ~ShaderManager();
+
+  // Must be called with the context current. Programs are built through
+  // |cache|, which has to outlive the manager. |worker_context| may be
+  // EGL_NO_CONTEXT; otherwise it shares objects with the current context
+  // and can be made current without a surface.
+  void init(ProgramCache* cache,
+            EGLDisplay display = EGL_NO_DISPLAY,
+            EGLContext worker_context = EGL_NO_CONTEXT);
+
+  ProgramHandle create_program(const char* vertShaderText,
+                               const char* fragShaderText,
+                               const AttribBinding* bindings,
+                               int binding_count);
+  ProgramHandle create_program_async(const char* vertShaderText,
+                                     const char* fragShaderText,
+                                     const AttribBinding* bindings,
+                                     int binding_count);
+  void destroy_all();
+
+  // Whether wait() would return at once.
+  bool is_ready(ProgramHandle program);
+  void wait(ProgramHandle program);
+
+  // Location of an active uniform or attribute, or -1. Array uniforms can
+  // be named with or without "[0]".
+  GLint uniform_location(ProgramHandle program, const char* name);
+  GLint attrib_location(ProgramHandle program, const char* name);
+
+  GLuint program_id(ProgramHandle program);
+
+  void use(ProgramHandle program);
+  ProgramHandle current() const { return current_; }
+
+  // Runs |draws| sorted by program, so each program is made current once.
+  // Draws that share a program keep their order. Reorders |draws|.
+  void submit(Draw* draws, int count);
+
+  // glUseProgram calls made so far.
+  unsigned program_switches() const { return program_switches_; }
+  // Time spent blocked on programs that were not built yet.
+  double wait_milliseconds() const { return wait_milliseconds_; }
+
+ private:
+  struct Location {
+    std::string name;
+    GLint location;
+  };
+
+  // A program for the worker thread to build.
+  struct Job {
+    std::string vert;
+    std::string frag;
+    std::vector<std::string> names;
+    std::vector<GLuint> indices;
+    GLuint program;
+    bool done;
+  };
+
+  struct Program {
+    GLuint id;
+    // Set while the program is still being built.
+    bool pending;
+    ProgramCache::Pending compile;
+    Job* job;
+    // Ranges of uniforms_ and attribs_.
+    unsigned first_uniform;
+    unsigned uniform_count;
+    unsigned first_attrib;
+    unsigned attrib_count;
+  };
+
+  Program& get(ProgramHandle program);
+  void read_locations(Program* program);
+  void read_locations(GLuint id, bool uniforms);
+  static GLint find(const std::vector<Location>& table,
+                    unsigned first,
+                    unsigned count,
+                    const char* name);
+  void run_worker();
+  void stop_worker();
+
+  ProgramCache* cache_;
+  std::vector<Program> programs_;
+  std::vector<Location> uniforms_;
+  std::vector<Location> attribs_;
+  ProgramHandle current_;
+  unsigned program_switches_;
+  double wait_milliseconds_;
+
+  EGLDisplay display_;
+  EGLContext worker_context_;
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<Job>> jobs_;
+  size_t next_job_;
+  bool stop_;
+};
+
+#endif
@@ -0,0 +1,184 @@
+// Four-lane float vector used by the matrix kernels.
+//
+// The backend is chosen at build time: SSE2 on x86 (AVX builds use the same
+// intrinsics with VEX encoding), NEON on ARM, and a plain array otherwise.
+// Define GED_SIMD_SCALAR to force the scalar backend.
+//
+// Every operation is a lane-wise IEEE single precision add, sub, mul, div or
+// sqrt, so an algorithm written against Float4 produces bit-identical results
+// on every backend as long as the compiler does not contract mul+add into
+// FMA (build the scalar path with -ffp-contract=off on FMA capable targets).
+
+#ifndef GED_SIMD_H
+#define GED_SIMD_H
+
+#include <cmath>
+
+#if !defined(GED_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define GED_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif !defined(GED_SIMD_SCALAR) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define GED_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define GED_SIMD_NONE 1
+#endif
+
+namespace ged {
+namespace simd {
+
+#if defined(GED_SIMD_SSE2)
+
+typedef __m128 Float4;
+
+inline Float4 Load(const float* p) { return _mm_load_ps(p); }
+inline Float4 LoadU(const float* p) { return _mm_loadu_ps(p); }
+inline void Store(float* p, Float4 v) { _mm_store_ps(p, v); }
+inline void StoreU(float* p, Float4 v) { _mm_storeu_ps(p, v); }
+inline Float4 Splat(float f) { return _mm_set1_ps(f); }
+inline Float4 Set(float x, float y, float z, float w) {
+  return _mm_setr_ps(x, y, z, w);
+}
+inline Float4 Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 Div(Float4 a, Float4 b) { return _mm_div_ps(a, b); }
+inline Float4 Sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a, b); }
+
+template <int X, int Y, int Z, int W>
+inline Float4 Shuffle(Float4 v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+inline void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif defined(GED_SIMD_NEON)
+
+typedef float32x4_t Float4;
+
+inline Float4 Load(const float* p) { return vld1q_f32(p); }
+inline Float4 LoadU(const float* p) { return vld1q_f32(p); }
+inline void Store(float* p, Float4 v) { vst1q_f32(p, v); }
+inline void StoreU(float* p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 Splat(float f) { return vdupq_n_f32(f); }
+inline Float4 Set(float x, float y, float z, float w) {
+  Float4 v = {x, y, z, w};
+  return v;
+}
+inline Float4 Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+// vmlaq_f32 may be fused on some cores, so multiply and add stay separate.
+inline Float4 Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 Min(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline Float4 Max(Float4 a, Float4 b) { return vmaxq_f32(a, b); }
+#if defined(__aarch64__)
+inline Float4 Div(Float4 a, Float4 b) { return vdivq_f32(a, b); }
+inline Float4 Sqrt(Float4 a) { return vsqrtq_f32(a); }
+#else
+// ARMv7 NEON has only reciprocal estimates, which are not exact.
+inline Float4 Div(Float4 a, Float4 b) {
+  return Set(vgetq_lane_f32(a, 0) / vgetq_lane_f32(b, 0),
+             vgetq_lane_f32(a, 1) / vgetq_lane_f32(b, 1),
+             vgetq_lane_f32(a, 2) / vgetq_lane_f32(b, 2),
+             vgetq_lane_f32(a, 3) / vgetq_lane_f32(b, 3));
+}
+inline Float4 Sqrt(Float4 a) {
+  return Set(sqrtf(vgetq_lane_f32(a, 0)), sqrtf(vgetq_lane_f32(a, 1)),
+             sqrtf(vgetq_lane_f32(a, 2)), sqrtf(vgetq_lane_f32(a, 3)));
+}
+#endif
+
+template <int X, int Y, int Z, int W>
+inline Float4 Shuffle(Float4 v) {
+  return Set(vgetq_lane_f32(v, X), vgetq_lane_f32(v, Y),
+             vgetq_lane_f32(v, Z), vgetq_lane_f32(v, W));
+}
+
+inline void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+  float32x4x2_t t01 = vtrnq_f32(r0, r1);
+  float32x4x2_t t23 = vtrnq_f32(r2, r3);
+  r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+
+struct Float4 {
+  float v[4];
+};
+
+inline Float4 Load(const float* p) {
+  Float4 r = {{p[0], p[1], p[2], p[3]}};
+  return r;
+}
+inline Float4 LoadU(const float* p) { return Load(p); }
+inline void Store(float* p, Float4 a) {
+  p[0] = a.v[0];
+  p[1] = a.v[1];
+  p[2] = a.v[2];
+  p[3] = a.v[3];
+}
+inline void StoreU(float* p, Float4 a) { Store(p, a); }
+inline Float4 Splat(float f) {
+  Float4 r = {{f, f, f, f}};
+  return r;
+}
+inline Float4 Set(float x, float y, float z, float w) {
+  Float4 r = {{x, y, z, w}};
+  return r;
+}
+
+#define GED_SIMD_LANEWISE(name, expr)          \
+  inline Float4 name(Float4 a, Float4 b) {     \
+    Float4 r;                                  \
+    for (int i = 0; i < 4; i++) {              \
+      float x = a.v[i], y = b.v[i];            \
+      r.v[i] = (expr);                         \
+    }                                          \
+    return r;                                  \
+  }
+GED_SIMD_LANEWISE(Add, x + y)
+GED_SIMD_LANEWISE(Sub, x - y)
+GED_SIMD_LANEWISE(Mul, x * y)
+GED_SIMD_LANEWISE(Div, x / y)
+GED_SIMD_LANEWISE(Min, x < y ? x : y)
+GED_SIMD_LANEWISE(Max, x > y ? x : y)
+#undef GED_SIMD_LANEWISE
+
+inline Float4 Sqrt(Float4 a) {
+  return Set(sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3]));
+}
+
+template <int X, int Y, int Z, int W>
+inline Float4 Shuffle(Float4 a) {
+  return Set(a.v[X], a.v[Y], a.v[Z], a.v[W]);
+}
+
+inline void Transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3) {
+  Float4 t0 = Set(r0.v[0], r1.v[0], r2.v[0], r3.v[0]);
+  Float4 t1 = Set(r0.v[1], r1.v[1], r2.v[1], r3.v[1]);
+  Float4 t2 = Set(r0.v[2], r1.v[2], r2.v[2], r3.v[2]);
+  Float4 t3 = Set(r0.v[3], r1.v[3], r2.v[3], r3.v[3]);
+  r0 = t0;
+  r1 = t1;
+  r2 = t2;
+  r3 = t3;
+}
+
+#endif
+
+// a * b + c, evaluated as two separately rounded operations.
+inline Float4 MulAdd(Float4 a, Float4 b, Float4 c) {
+  return Add(Mul(a, b), c);
+}
+
+}  // namespace simd
+}  // namespace ged
+
+#endif  // GED_SIMD_H
@@ -0,0 +1,141 @@
+#include "state_cache.h"
+
+namespace {
+
+const GLuint kUnknownTexture = ~0u;
+
+}  // namespace
+
+StateCache::StateCache() : calls_(0), filtered_(0) {
+  invalidate();
+}
+
+void StateCache::invalidate() {
+  viewport_valid_ = false;
+  scissor_valid_ = false;
+  clear_color_valid_ = false;
+  for (int i = 0; i < kCapCount; i++)
+    caps_[i] = -1;
+  active_texture_ = 0;
+  for (int i = 0; i < kMaxTextureUnits; i++) {
+    texture_2d_[i] = kUnknownTexture;
+    texture_cube_[i] = kUnknownTexture;
+  }
+}
+
+bool StateCache::filter(bool unchanged) {
+  if (unchanged)
+    filtered_++;
+  else
+    calls_++;
+  return unchanged;
+}
+
+void StateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  if (filter(viewport_valid_ && viewport_[0] == x && viewport_[1] == y &&
+             viewport_[2] == width && viewport_[3] == height))
+    return;
+  glViewport(x, y, width, height);
+  viewport_[0] = x;
+  viewport_[1] = y;
+  viewport_[2] = width;
+  viewport_[3] = height;
+  viewport_valid_ = true;
+}
+
+void StateCache::scissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+  if (filter(scissor_valid_ && scissor_[0] == x && scissor_[1] == y &&
+             scissor_[2] == width && scissor_[3] == height))
+    return;
+  glScissor(x, y, width, height);
+  scissor_[0] = x;
+  scissor_[1] = y;
+  scissor_[2] = width;
+  scissor_[3] = height;
+  scissor_valid_ = true;
+}
+
+void StateCache::clear_color(GLfloat red,
+                             GLfloat green,
+                             GLfloat blue,
+                             GLfloat alpha) {
+  if (filter(clear_color_valid_ && clear_color_[0] == red &&
+             clear_color_[1] == green && clear_color_[2] == blue &&
+             clear_color_[3] == alpha))
+    return;
+  glClearColor(red, green, blue, alpha);
+  clear_color_[0] = red;
+  clear_color_[1] = green;
+  clear_color_[2] = blue;
+  clear_color_[3] = alpha;
+  clear_color_valid_ = true;
+}
+
+StateCache::Cap StateCache::cap_index(GLenum cap) {
+  switch (cap) {
+    case GL_BLEND:
+      return kBlend;
+    case GL_CULL_FACE:
+      return kCullFace;
+    case GL_DEPTH_TEST:
+      return kDepthTest;
+    case GL_DITHER:
+      return kDither;
+    case GL_POLYGON_OFFSET_FILL:
+      return kPolygonOffsetFill;
+    case GL_SCISSOR_TEST:
+      return kScissorTest;
+    case GL_STENCIL_TEST:
+      return kStencilTest;
+    default:
+      return kUntracked;
+  }
+}
+
+void StateCache::set_cap(GLenum cap, bool enabled) {
+  Cap index = cap_index(cap);
+  if (index != kUntracked && filter(caps_[index] == enabled))
+    return;
+  if (index == kUntracked)
+    calls_++;
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  if (index != kUntracked)
+    caps_[index] = enabled;
+}
+
+void StateCache::enable(GLenum cap) {
+  set_cap(cap, true);
+}
+
+void StateCache::disable(GLenum cap) {
+  set_cap(cap, false);
+}
+
+void StateCache::active_texture(GLenum texture) {
+  if (filter(active_texture_ == texture))
+    return;
+  glActiveTexture(texture);
+  active_texture_ = texture;
+}
+
+void StateCache::bind_texture(GLenum target, GLuint texture) {
+  GLuint* bound = nullptr;
+  unsigned unit = active_texture_ - GL_TEXTURE0;
+  // Without a known active unit nothing can be shadowed.
+  if (active_texture_ && unit < kMaxTextureUnits) {
+    if (target == GL_TEXTURE_2D)
+      bound = &texture_2d_[unit];
+    else if (target == GL_TEXTURE_CUBE_MAP)
+      bound = &texture_cube_[unit];
+  }
+  if (bound && filter(*bound == texture))
+    return;
+  if (!bound)
+    calls_++;
+  glBindTexture(target, texture);
+  if (bound)
+    *bound = texture;
+}
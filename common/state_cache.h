@@ -0,0 +1,70 @@
+#ifndef OPENGL_WAYLAND_STATE_CACHE_H_
+#define OPENGL_WAYLAND_STATE_CACHE_H_
+
+#include <GLES2/gl2.h>
+
+// Shadows the fixed-function state that draw callbacks set every frame and
+// drops the calls that would not change it. Each method has the arguments
+// of the GL call it wraps.
+//
+// The shadow only knows what went through it. Code that changes the same
+// state with plain GL calls, or a context switch, has to call invalidate().
+class StateCache {
+ public:
+  StateCache();
+
+  // Forgets the shadowed state, so the next call of each kind reaches GL.
+  void invalidate();
+
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+  void clear_color(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+  void enable(GLenum cap);
+  void disable(GLenum cap);
+  void active_texture(GLenum texture);
+  // Binds to the active unit.
+  void bind_texture(GLenum target, GLuint texture);
+
+  // Calls made to GL, and calls dropped because they changed nothing.
+  unsigned calls() const { return calls_; }
+  unsigned filtered() const { return filtered_; }
+  void reset_counters() { calls_ = filtered_ = 0; }
+
+ private:
+  static const int kMaxTextureUnits = 8;
+
+  enum Cap {
+    kBlend,
+    kCullFace,
+    kDepthTest,
+    kDither,
+    kPolygonOffsetFill,
+    kScissorTest,
+    kStencilTest,
+    kCapCount,
+    kUntracked = kCapCount
+  };
+
+  static Cap cap_index(GLenum cap);
+  void set_cap(GLenum cap, bool enabled);
+  bool filter(bool unchanged);
+
+  bool viewport_valid_;
+  GLint viewport_[4];
+  bool scissor_valid_;
+  GLint scissor_[4];
+  bool clear_color_valid_;
+  GLfloat clear_color_[4];
+  // -1 unknown, otherwise 0 or 1.
+  int caps_[kCapCount];
+  // GL_TEXTURE0 + unit, or 0 when unknown.
+  GLenum active_texture_;
+  // Per unit, ~0u when unknown.
+  GLuint texture_2d_[kMaxTextureUnits];
+  GLuint texture_cube_[kMaxTextureUnits];
+
+  unsigned calls_;
+  unsigned filtered_;
+};
+
+#endif
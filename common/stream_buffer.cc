@@ -0,0 +1,172 @@
+#include "stream_buffer.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+StreamBuffer::StreamBuffer()
+    : target_(GL_ARRAY_BUFFER),
+      buffer_(0),
+      size_(0),
+      map_buffer_range_(false),
+      head_(0),
+      used_(0),
+      frame_bytes_(0),
+      first_frame_(0),
+      frame_count_(0),
+      mapped_offset_(0),
+      mapped_size_(0),
+      orphan_count_(0) {}
+
+void StreamBuffer::init(GLenum target, GLsizeiptr size, bool map_buffer_range) {
+  target_ = target;
+  size_ = size;
+  map_buffer_range_ = map_buffer_range;
+
+  glGenBuffers(1, &buffer_);
+  glBindBuffer(target_, buffer_);
+  glBufferData(target_, size_, NULL, GL_STREAM_DRAW);
+  glBindBuffer(target_, 0);
+
+  if (!map_buffer_range_)
+    staging_.resize(size_);
+}
+
+void StreamBuffer::destroy() {
+  for (int i = 0; i < frame_count_; i++)
+    glDeleteSync(frames_[(first_frame_ + i) % kMaxFrames].fence);
+  frame_count_ = 0;
+  if (buffer_)
+    glDeleteBuffers(1, &buffer_);
+  buffer_ = 0;
+  staging_.clear();
+}
+
+void StreamBuffer::retire_frames() {
+  while (frame_count_) {
+    Frame& frame = frames_[first_frame_];
+    // A zero timeout only polls the fence.
+    GLenum status = glClientWaitSync(frame.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      break;
+    glDeleteSync(frame.fence);
+    used_ -= frame.bytes;
+    first_frame_ = (first_frame_ + 1) % kMaxFrames;
+    frame_count_--;
+  }
+}
+
+void StreamBuffer::wait_frame() {
+  glClientWaitSync(frames_[first_frame_].fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                   GL_TIMEOUT_IGNORED);
+  retire_frames();
+}
+
+void StreamBuffer::orphan() {
+  // The driver keeps the old storage alive for the draws that still read it
+  // and hands out new storage, so nothing waits.
+  glBufferData(target_, size_, NULL, GL_STREAM_DRAW);
+  for (int i = 0; i < frame_count_; i++)
+    glDeleteSync(frames_[(first_frame_ + i) % kMaxFrames].fence);
+  frame_count_ = 0;
+  head_ = 0;
+  used_ = 0;
+  frame_bytes_ = 0;
+  orphan_count_++;
+}
+
+void* StreamBuffer::map(GLsizeiptr size, GLsizeiptr alignment,
+                        GLintptr* offset) {
+  assert(buffer_ && !mapped_size_);
+  assert(size > 0 && size <= size_ && alignment > 0);
+
+  glBindBuffer(target_, buffer_);
+
+  GLintptr start = (head_ + alignment - 1) / alignment * alignment;
+  bool wrap = start + size > size_;
+  if (wrap)
+    start = 0;
+  // Padding and the skipped tail of the ring count as used until the frame
+  // is retired.
+  GLsizeiptr bytes = wrap ? size_ - head_ + size : start - head_ + size;
+
+  if (map_buffer_range_) {
+    if (used_ + bytes > size_)
+      retire_frames();
+    if (used_ + bytes > size_ && !frame_bytes_) {
+      orphan();
+      start = 0;
+      bytes = size;
+    }
+    while (used_ + bytes > size_ && frame_count_)
+      wait_frame();
+  } else if (wrap && !frame_bytes_) {
+    // Without fences there is no telling whether the start of the ring is
+    // still read, so every lap gets new storage. Later in a frame,
+    // glBufferSubData waits for the draws that read it.
+    orphan();
+    bytes = size;
+  }
+  if (used_ + bytes > size_) {
+    fprintf(stderr, "Error: a frame streamed more than the %ld byte ring\n",
+            static_cast<long>(size_));
+    exit(1);
+  }
+
+  head_ = start + size;
+  used_ += bytes;
+  frame_bytes_ += bytes;
+  mapped_offset_ = start;
+  mapped_size_ = size;
+  *offset = start;
+
+  if (!map_buffer_range_)
+    return &staging_[start];
+
+  void* ptr = glMapBufferRange(
+      target_, start, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT);
+  assert(ptr);
+  return ptr;
+}
+
+void StreamBuffer::unmap() {
+  assert(mapped_size_);
+  if (map_buffer_range_) {
+    glUnmapBuffer(target_);
+  } else {
+    glBufferSubData(target_, mapped_offset_, mapped_size_,
+                    &staging_[mapped_offset_]);
+  }
+  mapped_size_ = 0;
+}
+
+void StreamBuffer::end_frame() {
+  assert(!mapped_size_);
+  if (!map_buffer_range_) {
+    used_ = 0;
+    frame_bytes_ = 0;
+    return;
+  }
+  if (!frame_bytes_)
+    return;
+
+  if (frame_count_ == kMaxFrames) {
+    retire_frames();
+    if (frame_count_ == kMaxFrames) {
+      // Too many frames in flight to track. The next map() starts over in
+      // new storage.
+      glBindBuffer(target_, buffer_);
+      orphan();
+      return;
+    }
+  }
+
+  Frame& frame = frames_[(first_frame_ + frame_count_) % kMaxFrames];
+  frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame.bytes = frame_bytes_;
+  frame_count_++;
+  frame_bytes_ = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef OPENGL_WAYLAND_STREAM_BUFFER_H_
+#define OPENGL_WAYLAND_STREAM_BUFFER_H_
+
+#include <GLES3/gl3.h>
+
+#include <vector>
+
+// Ring allocator for transient data that is written once and drawn once,
+// such as geometry that changes every frame.
+//
+// Each map() hands out the next free range of one buffer object. On OpenGL
+// ES 3 the range is mapped with GL_MAP_UNSYNCHRONIZED_BIT, and a fence
+// inserted by end_frame() tells when the GPU is done with a frame's ranges,
+// so the space is only reused once the fence has signaled. If the ring runs
+// into a frame that is still in flight, the buffer is orphaned instead of
+// waiting for it. On ES 2 the data is staged in memory and uploaded with
+// glBufferSubData on unmap(), and the buffer is orphaned on wrap.
+//
+// Ranges may be drawn any time before end_frame(), so orphaning would lose
+// the ones handed out earlier in the frame. Only the first map() of a frame
+// orphans; later ones wait for the frames in flight instead. One frame's
+// ranges have to fit in the ring, or map() exits with an error.
+//
+// map() binds the buffer to its target. Unbind any mesh first, since a bound
+// vertex array object would record the attribute pointers.
+class StreamBuffer {
+ public:
+  StreamBuffer();
+
+  // Must be called with the context current.
+  void init(GLenum target, GLsizeiptr size, bool map_buffer_range);
+  void destroy();
+
+  // Returns |size| bytes of write-only memory, and in |offset| where they
+  // start in buffer(). Only one range can be mapped at a time.
+  void* map(GLsizeiptr size, GLsizeiptr alignment, GLintptr* offset);
+  void unmap();
+
+  // Fences the ranges handed out since the last call. Called once per frame,
+  // after the draws that read them.
+  void end_frame();
+
+  GLuint buffer() const { return buffer_; }
+  // Number of times the buffer was orphaned because the ring was full.
+  unsigned orphan_count() const { return orphan_count_; }
+
+ private:
+  // Frames that can be in flight before the ring is considered full.
+  static const int kMaxFrames = 4;
+
+  struct Frame {
+    GLsync fence;
+    GLsizeiptr bytes;  // Ring space used by the frame, including padding.
+  };
+
+  void retire_frames();
+  // Waits for the oldest frame in flight, and retires it.
+  void wait_frame();
+  void orphan();
+
+  GLenum target_;
+  GLuint buffer_;
+  GLsizeiptr size_;
+  bool map_buffer_range_;
+
+  // Next free byte, and bytes in use from the oldest unfenced frame on.
+  GLintptr head_;
+  GLsizeiptr used_;
+  GLsizeiptr frame_bytes_;
+
+  Frame frames_[kMaxFrames];
+  int first_frame_;
+  int frame_count_;
+
+  // The mapped range.
+  GLintptr mapped_offset_;
+  GLsizeiptr mapped_size_;
+  // ES 2 staging memory for the mapped range.
+  std::vector<char> staging_;
+
+  unsigned orphan_count_;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Per thread. At a few hundred events a frame, a few seconds' worth.
+const uint64_t kRingEvents = 1 << 16;
+const int kMaxThreads = 64;
+
+struct TraceEvent {
+  const char* name;
+  int64_t start;
+  int64_t duration;  // -1 for an instant event.
+};
+
+struct TraceRing {
+  TraceEvent events[kRingEvents];
+  // Events written so far. Only the owning thread stores it; the store
+  // publishes the event before it.
+  std::atomic<uint64_t> head;
+  std::atomic<const char*> thread_name;
+  int tid;
+};
+
+std::atomic<TraceRing*> rings[kMaxThreads];
+std::atomic<int> ring_count(0);
+const char* trace_path = nullptr;
+thread_local TraceRing* current_ring = nullptr;
+
+// Creates the calling thread's ring on its first event. Threads past
+// kMaxThreads are not recorded.
+TraceRing* ring_for_thread() {
+  if (current_ring)
+    return current_ring;
+  int index = ring_count.fetch_add(1);
+  if (index >= kMaxThreads)
+    return nullptr;
+  TraceRing* ring = new TraceRing();
+  ring->head.store(0);
+  ring->thread_name.store(nullptr);
+  ring->tid = index + 1;
+  rings[index].store(ring, std::memory_order_release);
+  current_ring = ring;
+  return ring;
+}
+
+void record(const char* name, int64_t start, int64_t duration) {
+  TraceRing* ring = ring_for_thread();
+  if (!ring)
+    return;
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  TraceEvent& event = ring->events[head % kRingEvents];
+  event.name = name;
+  event.start = start;
+  event.duration = duration;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+}  // namespace
+
+std::atomic<bool> Trace::enabled_(false);
+
+void Trace::init() {
+#ifndef OPENGL_WAYLAND_NO_TRACE
+  trace_path = getenv("OPENGL_WAYLAND_TRACE");
+  enabled_.store(trace_path && *trace_path);
+#endif
+}
+
+int64_t Trace::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+void Trace::complete(const char* name, int64_t start, int64_t end) {
+  record(name, start, end - start);
+}
+
+void Trace::instant(const char* name) {
+  record(name, now(), -1);
+}
+
+void Trace::set_thread_name(const char* name) {
+  TraceRing* ring = ring_for_thread();
+  if (ring)
+    ring->thread_name.store(name);
+}
+
+bool Trace::write() {
+  if (!enabled())
+    return false;
+  FILE* file = fopen(trace_path, "w");
+  if (!file) {
+    perror(trace_path);
+    return false;
+  }
+
+  int pid = getpid();
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  bool first = true;
+  std::vector<TraceEvent> events;
+  int count = std::min(ring_count.load(), kMaxThreads);
+  for (int i = 0; i < count; i++) {
+    TraceRing* ring = rings[i].load(std::memory_order_acquire);
+    if (!ring)
+      continue;
+
+    // Copy what was published, then drop whatever the owner may have
+    // overwritten during the copy, including the slot it is writing now.
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t begin = head > kRingEvents ? head - kRingEvents : 0;
+    events.clear();
+    for (uint64_t n = begin; n < head; n++)
+      events.push_back(ring->events[n % kRingEvents]);
+    uint64_t later = ring->head.load(std::memory_order_acquire) + 1;
+    uint64_t valid = later > kRingEvents ? later - kRingEvents : 0;
+    size_t skip = valid > begin ? std::min<uint64_t>(valid - begin, head - begin)
+                                : 0;
+
+    const char* thread_name = ring->thread_name.load();
+    if (thread_name) {
+      fprintf(file,
+              "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+              "\"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+              first ? "" : ",\n", pid, ring->tid, thread_name);
+      first = false;
+    }
+    for (size_t e = skip; e < events.size(); e++) {
+      const TraceEvent& event = events[e];
+      if (event.duration < 0) {
+        fprintf(file,
+                "%s{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", "
+                "\"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+                first ? "" : ",\n", event.name, event.start / 1e3, pid,
+                ring->tid);
+      } else {
+        fprintf(file,
+                "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, "
+                "\"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                first ? "" : ",\n", event.name, event.start / 1e3,
+                event.duration / 1e3, pid, ring->tid);
+      }
+      first = false;
+    }
+  }
+  fprintf(file, "\n]}\n");
+  bool ok = ferror(file) == 0;
+  fclose(file);
+  return ok;
+}
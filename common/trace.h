@@ -0,0 +1,104 @@
+#ifndef OPENGL_WAYLAND_TRACE_H_
+#define OPENGL_WAYLAND_TRACE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+// CPU trace events in the Chrome trace event format, for chrome://tracing
+// or ui.perfetto.dev.
+//
+// Recording starts with OPENGL_WAYLAND_TRACE set to the file to write. Each
+// thread appends fixed-size events to a ring of its own, so recording
+// takes no lock and never allocates after a thread's first event; once a
+// ring is full, its oldest events are overwritten. write() copies the rings
+// while the other threads keep recording, and skips the events overwritten
+// meanwhile. The platform writes the file when it terminates, and whenever
+// the process gets SIGUSR1.
+//
+// Use the TRACE_ macros rather than the class. Building with
+// -DOPENGL_WAYLAND_NO_TRACE compiles them out.
+class Trace {
+ public:
+  // Reads OPENGL_WAYLAND_TRACE. Called once, before other threads trace.
+  static void init();
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // In nanoseconds on CLOCK_MONOTONIC.
+  static int64_t now();
+  // An event from |start| to |end|, which may have been measured on
+  // another thread.
+  static void complete(const char* name, int64_t start, int64_t end);
+  static void instant(const char* name);
+  // Names the calling thread in the trace.
+  static void set_thread_name(const char* name);
+
+  // Writes every thread's events to the file. Returns false if it could
+  // not be written.
+  static bool write();
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+// Records the rest of the enclosing block as one event.
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name)
+      : name_(name), start_(Trace::enabled() ? Trace::now() : 0) {}
+  ~TraceScope() {
+    if (start_)
+      Trace::complete(name_, start_, Trace::now());
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  void operator=(const TraceScope&) = delete;
+
+ private:
+  const char* name_;
+  int64_t start_;
+};
+
+#ifndef OPENGL_WAYLAND_NO_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// |name| is kept, so it has to be a string literal.
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name) \
+  do {                      \
+    if (Trace::enabled())   \
+      Trace::instant(name); \
+  } while (0)
+// For spans that start and end in different places: take TRACE_NOW() at
+// the start and pass it to TRACE_COMPLETE() at the end. A start of 0 is
+// ignored, which is what TRACE_NOW() gives while not recording.
+#define TRACE_NOW() (Trace::enabled() ? Trace::now() : 0)
+#define TRACE_COMPLETE(name, start)                     \
+  do {                                                  \
+    int64_t trace_start = (start);                      \
+    if (trace_start && Trace::enabled())                \
+      Trace::complete(name, trace_start, Trace::now()); \
+  } while (0)
+#define TRACE_THREAD_NAME(name)     \
+  do {                              \
+    if (Trace::enabled())           \
+      Trace::set_thread_name(name); \
+  } while (0)
+#else
+#define TRACE_SCOPE(name) \
+  do {                    \
+  } while (0)
+#define TRACE_INSTANT(name) \
+  do {                      \
+  } while (0)
+#define TRACE_NOW() static_cast<int64_t>(0)
+#define TRACE_COMPLETE(name, start) \
+  do {                              \
+    (void)(start);                  \
+  } while (0)
+#define TRACE_THREAD_NAME(name) \
+  do {                          \
+  } while (0)
+#endif
+
+#endif
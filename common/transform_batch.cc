@@ -0,0 +1,159 @@
+#include "transform_batch.h"
+
+#include <assert.h>
+
+#include "simd.h"
+
+namespace ged {
+
+using namespace simd;
+
+namespace {
+
+const size_t kPadding = 3;
+
+const float kDefaults[TransformBatch::kComponentCount] = {
+    0.0f, 0.0f, 0.0f,        // position
+    0.0f, 0.0f, 0.0f, 1.0f,  // rotation
+    1.0f, 1.0f, 1.0f,        // scale
+};
+
+// Writes row r of four matrices whose elements are held lane-wise in
+// e0..e3 (element [r][c] of matrix l is lane l of e<c>).
+inline void StoreRow(Float4 e0,
+                     Float4 e1,
+                     Float4 e2,
+                     Float4 e3,
+                     int r,
+                     float* out,
+                     size_t stride,
+                     size_t lanes) {
+  simd::Transpose(e0, e1, e2, e3);
+  Float4 rows[4] = {e0, e1, e2, e3};
+  for (size_t l = 0; l < lanes; l++)
+    StoreU(out + l * stride + 4 * r, rows[l]);
+}
+
+}  // namespace
+
+TransformBatch::TransformBatch() : count_(0) {
+  Resize(0);
+}
+
+TransformBatch::TransformBatch(size_t count) : count_(0) {
+  Resize(count);
+}
+
+void TransformBatch::Resize(size_t count) {
+  for (int c = 0; c < kComponentCount; c++) {
+    // Drop the old padding first so that grown records get the defaults.
+    components_[c].resize(count_);
+    components_[c].resize(count + kPadding, kDefaults[c]);
+  }
+  count_ = count;
+}
+
+void TransformBatch::SetPosition(size_t i, float x, float y, float z) {
+  assert(i < count_);
+  components_[kPositionX][i] = x;
+  components_[kPositionY][i] = y;
+  components_[kPositionZ][i] = z;
+}
+
+void TransformBatch::SetRotation(size_t i,
+                                 float x,
+                                 float y,
+                                 float z,
+                                 float w) {
+  assert(i < count_);
+  components_[kRotationX][i] = x;
+  components_[kRotationY][i] = y;
+  components_[kRotationZ][i] = z;
+  components_[kRotationW][i] = w;
+}
+
+void TransformBatch::SetScale(size_t i, float sx, float sy, float sz) {
+  assert(i < count_);
+  components_[kScaleX][i] = sx;
+  components_[kScaleY][i] = sy;
+  components_[kScaleZ][i] = sz;
+}
+
+void TransformBatch::ComputeMVP(const Matrix& view_projection,
+                                float* out,
+                                size_t stride,
+                                size_t begin,
+                                size_t end) const {
+  assert(stride >= 16);
+  assert(begin <= end && end <= count_);
+
+  const float* vp = view_projection.Data();
+  Float4 vp_splat[4][4];
+  for (int k = 0; k < 4; k++) {
+    for (int c = 0; c < 4; c++)
+      vp_splat[k][c] = Splat(vp[4 * k + c]);
+  }
+
+  const Float4 one = Splat(1.0f);
+  const Float4 two = Splat(2.0f);
+
+  for (size_t i = begin; i < end; i += 4) {
+    size_t lanes = end - i < 4 ? end - i : 4;
+
+    Float4 px = LoadU(&components_[kPositionX][i]);
+    Float4 py = LoadU(&components_[kPositionY][i]);
+    Float4 pz = LoadU(&components_[kPositionZ][i]);
+    Float4 qx = LoadU(&components_[kRotationX][i]);
+    Float4 qy = LoadU(&components_[kRotationY][i]);
+    Float4 qz = LoadU(&components_[kRotationZ][i]);
+    Float4 qw = LoadU(&components_[kRotationW][i]);
+    Float4 sx = LoadU(&components_[kScaleX][i]);
+    Float4 sy = LoadU(&components_[kScaleY][i]);
+    Float4 sz = LoadU(&components_[kScaleZ][i]);
+
+    Float4 xx = Mul(qx, qx);
+    Float4 yy = Mul(qy, qy);
+    Float4 zz = Mul(qz, qz);
+    Float4 xy = Mul(qx, qy);
+    Float4 xz = Mul(qx, qz);
+    Float4 yz = Mul(qy, qz);
+    Float4 wx = Mul(qw, qx);
+    Float4 wy = Mul(qw, qy);
+    Float4 wz = Mul(qw, qz);
+
+    // Upper 3x3 of the model matrix: rotation rows scaled per axis.
+    Float4 m[3][3];
+    m[0][0] = Mul(Sub(one, Mul(two, Add(yy, zz))), sx);
+    m[0][1] = Mul(Mul(two, Sub(xy, wz)), sx);
+    m[0][2] = Mul(Mul(two, Add(xz, wy)), sx);
+    m[1][0] = Mul(Mul(two, Add(xy, wz)), sy);
+    m[1][1] = Mul(Sub(one, Mul(two, Add(xx, zz))), sy);
+    m[1][2] = Mul(Mul(two, Sub(yz, wx)), sy);
+    m[2][0] = Mul(Mul(two, Sub(xz, wy)), sz);
+    m[2][1] = Mul(Mul(two, Add(yz, wx)), sz);
+    m[2][2] = Mul(Sub(one, Mul(two, Add(xx, yy))), sz);
+
+    float* dst = out + i * stride;
+    for (int r = 0; r < 3; r++) {
+      Float4 e[4];
+      for (int c = 0; c < 4; c++) {
+        Float4 v = Mul(m[r][0], vp_splat[0][c]);
+        v = MulAdd(m[r][1], vp_splat[1][c], v);
+        e[c] = MulAdd(m[r][2], vp_splat[2][c], v);
+      }
+      StoreRow(e[0], e[1], e[2], e[3], r, dst, stride, lanes);
+    }
+
+    // The translation row is (px, py, pz, 1).
+    Float4 e[4];
+    for (int c = 0; c < 4; c++) {
+      Float4 v = Mul(px, vp_splat[0][c]);
+      v = MulAdd(py, vp_splat[1][c], v);
+      v = MulAdd(pz, vp_splat[2][c], v);
+      e[c] = Add(v, vp_splat[3][c]);
+    }
+    StoreRow(e[0], e[1], e[2], e[3], 3, dst, stride, lanes);
+  }
+}
+
+}  // namespace ged
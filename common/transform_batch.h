@@ -0,0 +1,93 @@
+#ifndef GED_TRANSFORM_BATCH_H
+#define GED_TRANSFORM_BATCH_H
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "matrix.h"
+#include "quaternion.h"
+
+namespace ged {
+
+// Structure-of-arrays storage for per-object transforms. Each record is a
+// position, a unit quaternion rotation (x, y, z, w) and a scale, and expands
+// to the same matrix as
+//
+//   Matrix m;
+//   m.Translate(px, py, pz);
+//   m.Rotate(Quaternion(x, y, z, w));
+//   m.Scale(sx, sy, sz);
+//   m.MatrixMultiply(view_projection);
+//
+// ComputeMVP evaluates four records per step with the kernels from simd.h.
+class TransformBatch {
+ public:
+  enum Component {
+    kPositionX,
+    kPositionY,
+    kPositionZ,
+    kRotationX,
+    kRotationY,
+    kRotationZ,
+    kRotationW,
+    kScaleX,
+    kScaleY,
+    kScaleZ,
+    kComponentCount
+  };
+
+  TransformBatch();
+  explicit TransformBatch(size_t count);
+
+  // New records start at the origin with no rotation and unit scale.
+  void Resize(size_t count);
+  size_t Size() const { return count_; }
+
+  void SetPosition(size_t i, float x, float y, float z);
+  void SetRotation(size_t i, float x, float y, float z, float w);
+  void SetRotation(size_t i, const Quaternion& q) {
+    SetRotation(i, q.x, q.y, q.z, q.w);
+  }
+  void SetScale(size_t i, float sx, float sy, float sz);
+
+  // Direct access to one component array, for bulk updates.
+  float* Data(Component c) { return components_[c].data(); }
+  const float* Data(Component c) const { return components_[c].data(); }
+
+  // The rotation arrays, for the batch functions in quaternion.h.
+  QuaternionArrays Rotations() {
+    QuaternionArrays q = {Data(kRotationX), Data(kRotationY),
+                          Data(kRotationZ), Data(kRotationW)};
+    return q;
+  }
+  ConstQuaternionArrays Rotations() const {
+    ConstQuaternionArrays q = {Data(kRotationX), Data(kRotationY),
+                               Data(kRotationZ), Data(kRotationW)};
+    return q;
+  }
+
+  // Writes the MVP of records [begin, end) to out + i * stride, where
+  // stride is in floats and at least 16. Each matrix has the layout of
+  // Matrix::Data(). |out| does not need to be aligned, so it can point
+  // straight into a mapped uniform or instance buffer. Disjoint ranges may
+  // be computed concurrently.
+  void ComputeMVP(const Matrix& view_projection,
+                  float* out,
+                  size_t stride,
+                  size_t begin,
+                  size_t end) const;
+  void ComputeMVP(const Matrix& view_projection, float* out) const {
+    ComputeMVP(view_projection, out, 16, 0, count_);
+  }
+
+ private:
+  size_t count_;
+  // Every array is padded by three records so a group of four can start at
+  // any index below count_.
+  std::vector<float> components_[kComponentCount];
+};
+
+}  // namespace ged
+
+#endif  // GED_TRANSFORM_BATCH_H
@@ -1,18 +1,45 @@
 #include <assert.h>
-#include <iostream>
+#include <atomic>
+#include <errno.h>
+#include <limits.h>
 #include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "log.h"
+#include "trace.h"
 #include "wayland_platform.h"
 
 WaylandPlatform* g_instance = nullptr;
+// Writes the trace on the event thread when SIGUSR1 comes in.
+static std::atomic<EventLoop::Source*> g_traceSource(nullptr);
+
+// The step of the fixed clock animations run on with --bench.
+static const double kBenchmarkFrameTime = 1.0 / 60;
 
 static void signal_int(int signum) {
-  running = 0;
+  // Only writes to an eventfd, which is safe in a signal handler.
+  g_instance->getEventLoop()->quit();
+}
+
+static void signal_usr1(int signum) {
+  EventLoop::Source* source = g_traceSource.load();
+  if (source)
+    g_instance->getEventLoop()->signal(source);
+}
+
+static void write_trace(void* data) {
+  if (Trace::write())
+    LOG_INFO("Wrote %s", getenv("OPENGL_WAYLAND_TRACE"));
 }
 
-WaylandPlatform::WaylandPlatform() {
-  if (g_instance) 
-    std::cout << "There should only be a single WaylandPlatform.";
+WaylandPlatform::WaylandPlatform()
+    : startTime_(std::chrono::steady_clock::now()),
+      benchFrames_(0),
+      benchWarmup_(0) {
+  if (g_instance)
+    LOG_ERROR("There should only be a single WaylandPlatform");
   g_instance = this;
 }
 
@@ -27,17 +54,83 @@ std::unique_ptr<WaylandPlatform> WaylandPlatform::create() {
   return nullptr;
 }
 
+std::unique_ptr<WaylandPlatform> WaylandPlatform::create(int* argc,
+                                                         char** argv) {
+  std::unique_ptr<WaylandPlatform> backend(new WaylandPlatform());
+  // Bad options exit before connecting to anything.
+  backend->parseArguments(argc, argv);
+  if (backend->initialize())
+    return backend;
+  return nullptr;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--bench N] [--warmup M] ...\n\n"
+          "  --bench N\tMeasure N frames and print the times as JSON\n"
+          "  --warmup M\tDraw M frames before measuring\n\n",
+          program);
+  exit(EXIT_FAILURE);
+}
+
+// Parses a decimal count that fits in |value|, without a sign.
+static bool parseCount(const char* text, unsigned* value) {
+  if (!text || *text < '0' || *text > '9')
+    return false;
+  char* end;
+  errno = 0;
+  unsigned long count = strtoul(text, &end, 10);
+  if (*end || errno == ERANGE || count > UINT_MAX)
+    return false;
+  *value = count;
+  return true;
+}
+
+// Removes the options it knows, so that the sample can parse the rest.
+void WaylandPlatform::parseArguments(int* argc, char** argv) {
+  int kept = 1;
+  for (int i = 1; i < *argc; i++) {
+    if (strcmp("--bench", argv[i]) == 0) {
+      if (!parseCount(argv[++i], &benchFrames_) || !benchFrames_)
+        usage(argv[0]);
+    } else if (strcmp("--warmup", argv[i]) == 0) {
+      if (!parseCount(argv[++i], &benchWarmup_))
+        usage(argv[0]);
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  *argc = kept;
+  argv[kept] = NULL;
+}
+
 WaylandPlatform* WaylandPlatform::getInstance() {
   return g_instance;
 }
 
 bool WaylandPlatform::initialize() {
+  // Messages are written on a thread of their own from here on.
+  Log::init();
+  // With OPENGL_WAYLAND_TRACE set, records trace events into that file.
+  Trace::init();
+  TRACE_THREAD_NAME("main");
+
   display_ = std::make_unique<WaylandDisplay>();
-  display_->InitializeDisplay();
+  bool headless = getenv("OPENGL_WAYLAND_HEADLESS") != NULL;
+  if (!headless && !display_->InitializeDisplay()) {
+    LOG_WARNING("No Wayland compositor, rendering headless");
+    headless = true;
+  }
+  if (headless)
+    display_->InitializeHeadless();
  
   gl_ = std::make_unique<GL>();
   gl_->init_egl(display_.get(), 0);
 
+  // One worker per core but one. OPENGL_WAYLAND_PIN_WORKERS keeps each on
+  // its own core.
+  jobs_.init(0, getenv("OPENGL_WAYLAND_PIN_WORKERS") != NULL);
+
   return true;
 }
 
@@ -46,13 +139,71 @@ void WaylandPlatform::createWindow(unsigned width, unsigned height,
     void (*drawPtr)(WaylandWindow*)) {
   struct sigaction sigint;
 
+  // The shaders compile while the surface is created, and while the
+  // caller loads its textures and meshes until run().
+  gl_->begin_init_gl(display_.get(), vertShaderText, fragShaderText);
   display_->CreateAcceleratedSurface(width, height);
   gl_->init_gl(width, height, vertShaderText, fragShaderText);
   display_->GetWindow()->drawPtr = drawPtr;
+  const char* mode = getenv("OPENGL_WAYLAND_PRESENT_MODE");
+  if (mode && !parsePresentMode(mode, &display_->GetWindow()->present_mode))
+    LOG_WARNING("Unknown OPENGL_WAYLAND_PRESENT_MODE: %s", mode);
+  // With OPENGL_WAYLAND_GPU_PROFILE set, the GPU time of each pass is
+  // logged as well.
+  bool gpuProfile = getenv("OPENGL_WAYLAND_GPU_PROFILE") != NULL;
+  if (gpuProfile || benchFrames_)
+    gl_->profiler.init(gpuProfile);
+  if (benchFrames_) {
+    display_->GetWindow()->benchmark.init(benchFrames_, benchWarmup_,
+                                          &gl_->profiler);
+    display_->GetWindow()->clock.set_step(kBenchmarkFrameTime);
+  }
   sigint.sa_handler = signal_int;
   sigemptyset(&sigint.sa_mask);
   sigint.sa_flags = SA_RESETHAND;
   sigaction(SIGINT, &sigint, NULL);
+
+  if (Trace::enabled()) {
+    struct sigaction sigusr1;
+    g_traceSource = display_->loop.add_event(write_trace, this);
+    sigusr1.sa_handler = signal_usr1;
+    sigemptyset(&sigusr1.sa_mask);
+    sigusr1.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sigusr1, NULL);
+  }
+}
+
+void WaylandPlatform::setUpdate(
+    void (*updatePtr)(WaylandWindow*, RenderQueue*)) {
+  display_->GetWindow()->updatePtr = updatePtr;
+}
+
+void WaylandPlatform::setPresentMode(PresentMode mode) {
+  display_->GetWindow()->present_mode = mode;
+}
+
+bool WaylandPlatform::parsePresentMode(const char* name, PresentMode* mode) {
+  if (strcmp(name, "fifo") == 0)
+    *mode = kPresentFifo;
+  else if (strcmp(name, "callback") == 0)
+    *mode = kPresentFrameCallback;
+  else if (strcmp(name, "mailbox") == 0)
+    *mode = kPresentMailbox;
+  else
+    return false;
+  return true;
+}
+
+const char* WaylandPlatform::presentModeName(PresentMode mode) {
+  switch (mode) {
+    case kPresentFifo:
+      return "fifo";
+    case kPresentFrameCallback:
+      return "callback";
+    case kPresentMailbox:
+      return "mailbox";
+  }
+  return "unknown";
 }
 
 void WaylandPlatform::initGL() {
@@ -60,11 +211,55 @@ void WaylandPlatform::initGL() {
 
 }
 
+// With OPENGL_WAYLAND_STARTUP set, prints how long it took from create() to
+// being ready for the first frame, and how much of that was spent waiting
+// for shaders the other startup work did not hide.
+void WaylandPlatform::reportStartup() {
+  if (!getenv("OPENGL_WAYLAND_STARTUP"))
+    return;
+  double total = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - startTime_)
+                     .count();
+  fprintf(stderr, "startup: %.2f ms, %.2f ms waiting for shaders\n", total,
+          gl_->shaders.wait_milliseconds());
+}
+
+// Dispatches events on the calling thread and draws on a render thread,
+// unless OPENGL_WAYLAND_SINGLE_THREAD is set.
 void WaylandPlatform::run() {
+  gl_->finish_init_gl();
+  reportStartup();
+
+  WaylandWindow* window = display_->GetWindow();
+  if (!getenv("OPENGL_WAYLAND_SINGLE_THREAD")) {
+    renderThread_.start(window, gl_.get(), &jobs_);
+    window->render_thread = &renderThread_;
+  }
   display_->Run();
+  window->render_thread = nullptr;
+  renderThread_.stop();
+
+  window->benchmark.report(presentModeName(window->present_mode),
+                           display_->headless);
+
+  if (getenv("OPENGL_WAYLAND_FRAME_STATS")) {
+    window->scheduler.report();
+    fprintf(stderr, "surface: %u requests over %u frames\n",
+            window->protocol_requests(), window->scheduler.drawn());
+  }
 }
 
 void WaylandPlatform::terminate() {
+  jobs_.shutdown();
+  if (g_traceSource.load()) {
+    signal(SIGUSR1, SIG_IGN);
+    display_->loop.remove(g_traceSource.exchange(nullptr));
+    write_trace(nullptr);
+  }
+  // The offscreen target needs the context that finish_egl() releases.
+  if (display_->headless)
+    display_->GetWindow()->destroy_offscreen();
   gl_->finish_egl(display_.get());
   display_->Terminate();
+  Log::shutdown();
 }
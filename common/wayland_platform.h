@@ -1,9 +1,11 @@
 #ifndef OPENGL_WAYLAND_PLATFORM_H_
 #define OPENGL_WAYLAND_PLATFORM_H_
 
+#include <chrono>
 #include <functional>
 #include "memory"
 #include "gl.h"
+#include "render_thread.h"
 
 class WaylandPlatform {
  public:
@@ -14,21 +16,48 @@ class WaylandPlatform {
   ~WaylandPlatform();
 
   static std::unique_ptr<WaylandPlatform> create();
+  // Also takes the options every sample has out of |argv|:
+  //   --bench N     Draws N measured frames, prints their times as JSON to
+  //                 stdout and quits. Animations run on a fixed clock.
+  //   --warmup M    Draws M frames before the measured ones.
+  static std::unique_ptr<WaylandPlatform> create(int* argc, char** argv);
    
   bool initialize();
   void createWindow(unsigned width, unsigned height,
       const char* vertShaderText, const char* fragShaderText,
       void (*drawPtr)(WaylandWindow*));
+  // Sets a scene update that records the window's draws off the render
+  // thread. Called between createWindow() and run().
+  void setUpdate(void (*updatePtr)(WaylandWindow*, RenderQueue*));
+  // Defaults to OPENGL_WAYLAND_PRESENT_MODE, or kPresentFifo.
+  void setPresentMode(PresentMode mode);
+  // Parses "fifo", "callback" or "mailbox".
+  static bool parsePresentMode(const char* name, PresentMode* mode);
+  static const char* presentModeName(PresentMode mode);
   static WaylandPlatform* getInstance();
   void initGL();
   void run();
   void terminate();
   GL* getGL() { return gl_.get(); }
+  WaylandWindow* getWindow() { return display_->GetWindow(); }
+  // For timers, and fds and events of the app's own, handled on the thread
+  // that called run().
+  EventLoop* getEventLoop() { return &display_->loop; }
+  // Worker threads for work split up within a frame.
+  JobSystem* getJobs() { return &jobs_; }
 
  private:
   WaylandPlatform();
+  void reportStartup();
+  void parseArguments(int* argc, char** argv);
+
+  std::chrono::steady_clock::time_point startTime_;
   std::unique_ptr<WaylandDisplay> display_;
   std::unique_ptr<GL> gl_;
+  JobSystem jobs_;
+  RenderThread renderThread_;
+  unsigned benchFrames_;
+  unsigned benchWarmup_;
 };
 
 #endif
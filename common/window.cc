@@ -1,10 +1,17 @@
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <cstdio>
 
+#include <algorithm>
+#include <vector>
+
 #include "window.h"
 #include "wayland_platform.h"
 
 #include "gl.h"
+#include "render_thread.h"
+#include "trace.h"
 
 void redraw(void* data, struct wl_callback* callback, unsigned int time);
 
@@ -12,10 +19,12 @@ const struct wl_callback_listener frame_listener = {redraw};
 
 void redraw(void* data, struct wl_callback* callback, unsigned int time) {
   WaylandWindow* window = static_cast<WaylandWindow*>(data);
-  struct wl_region* region;
+  TRACE_SCOPE("redraw");
+  if (callback)
+    TRACE_COMPLETE("frame callback", window->callback_requested.load());
 
-  assert(window->callback == callback);
-  window->callback = NULL;
+  assert(window->callback.load() == callback);
+  window->callback.store(NULL);
 
   if (callback)
     wl_callback_destroy(callback);
@@ -23,22 +32,330 @@ void redraw(void* data, struct wl_callback* callback, unsigned int time) {
   if (!window->configured)
     return;
 
-  window->drawPtr(window);
+  window->frame_due();
+}
+
+void WaylandWindow::frame_due() {
+  if (render_thread)
+    render_thread->request_frame();
+  else
+    draw_frame(NULL);
+}
+
+bool WaylandWindow::frame_pending() {
+  // In this order: the render thread sets the callback before it says the
+  // frame is no longer pending.
+  if (render_thread && render_thread->frame_pending())
+    return true;
+  return callback.load() != NULL;
+}
+
+static bool rect_empty(const struct rect& r) {
+  return r.width <= 0 || r.height <= 0;
+}
+
+static struct rect rect_union(const struct rect& a, const struct rect& b) {
+  if (rect_empty(a))
+    return b;
+  if (rect_empty(b))
+    return a;
+  int x0 = std::min(a.x, b.x);
+  int y0 = std::min(a.y, b.y);
+  int x1 = std::max(a.x + a.width, b.x + b.width);
+  int y1 = std::max(a.y + a.height, b.y + b.height);
+  struct rect r = {x0, y0, x1 - x0, y1 - y0};
+  return r;
+}
 
-  if (window->opaque || window->fullscreen) {
-    region = wl_compositor_create_region(window->display->compositor);
-    wl_region_add(region, 0, 0, window->geometry.width,
-                  window->geometry.height);
-    wl_surface_set_opaque_region(window->surface, region);
-    wl_region_destroy(region);
+static bool rect_equal(const struct rect& a, const struct rect& b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+void WaylandWindow::draw_frame(RenderQueue* frame) {
+  TRACE_SCOPE("frame");
+  GL* gl = WaylandPlatform::getInstance()->getGL();
+
+  scheduler.begin_frame();
+  gl->profiler.begin_frame();
+  benchmark.begin_frame();
+  struct rect damage = begin_damage();
+
+  // Unless the render thread runs the update as a job, it runs here before
+  // drawing.
+  if (!frame) {
+    clock.tick();
+    if (updatePtr) {
+      TRACE_SCOPE("update");
+      updatePtr(this, &gl->queue);
+    }
+  }
+
+  {
+    TRACE_SCOPE("draw");
+    GpuPass pass(&gl->profiler, "draw");
+    drawPtr(this);
+  }
+  {
+    TRACE_SCOPE("replay");
+    GpuPass pass(&gl->profiler, "replay");
+    if (frame)
+      frame->flush(gl);
+    // Replay whatever drawPtr recorded rather than drew.
+    gl->queue.flush(gl);
+  }
+  gl->stream.end_frame();
+  gl->state.disable(GL_SCISSOR_TEST);
+  gl->profiler.end_frame();
+  benchmark.end_frame();
+
+  if (display->headless) {
+    scheduler.end_frame(NULL);
+    finish_offscreen_frame(gl->isGLES3());
+    scheduler.end_swap();
+    if (benchmark.end_swap())
+      display->Quit();
+    display->FrameDone();
+    return;
+  }
+
+  // This only reaches the compositor when the size or the mode changed.
+  if (opaque || fullscreen) {
+    struct rect all = {0, 0, geometry.width, geometry.height};
+    set_opaque_region(&all);
   } else {
-    wl_surface_set_opaque_region(window->surface, NULL);
+    set_opaque_region(NULL);
   }
+  flush_surface_state();
 
-  window->callback = wl_surface_frame(window->surface);
-  wl_callback_add_listener(window->callback, &frame_listener, window);
+  // The swap interval belongs to the surface current on this thread.
+  if (swap_mode_ != present_mode) {
+    eglSwapInterval(display->egl.dpy, present_mode == kPresentFifo ? 1 : 0);
+    swap_mode_ = present_mode;
+  }
 
-  eglSwapBuffers(window->display->egl.dpy, window->egl_surface);
+  // In mailbox mode the next frame follows the compositor's reply to this
+  // commit rather than the next refresh.
+  callback_requested.store(TRACE_NOW());
+  {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    struct wl_callback* frame_callback;
+    if (present_mode == kPresentMailbox)
+      frame_callback = wl_display_sync(display_wrapper_);
+    else
+      frame_callback = wl_surface_frame(surface_wrapper_);
+    wl_callback_add_listener(frame_callback, &frame_listener, this);
+    callback.store(frame_callback);
+  }
+  protocol_requests_++;
+
+  scheduler.end_frame(surface);
+  swap_buffers(damage);
+  scheduler.end_swap();
+  if (benchmark.end_swap())
+    display->Quit();
+}
+
+struct rect WaylandWindow::begin_damage() {
+  struct rect damage;
+  bool tracking;
+  bool everything;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    everything = resize_pending_ || damage_all_;
+    if (resize_pending_) {
+      geometry = pending_size_;
+      if (native)
+        wl_egl_window_resize(native, geometry.width, geometry.height, 0, 0);
+      resize_pending_ = false;
+    }
+    tracking = damage_tracking_;
+    damage = pending_damage_;
+    pending_damage_ = {0, 0, 0, 0};
+    damage_all_ = false;
+  }
+
+  struct rect all = {0, 0, geometry.width, geometry.height};
+  if (!tracking || everything) {
+    damage = all;
+    damage_frames_ = 0;
+  }
+
+  // A buffer |age| frames old is missing this frame's damage and that of
+  // the age - 1 frames before it. Age 0 means its contents are undefined.
+  repaint = damage;
+  EGLint age = 0;
+  if (tracking && buffer_age_)
+    eglQuerySurface(display->egl.dpy, egl_surface, EGL_BUFFER_AGE_EXT, &age);
+  if (age <= 0 || age - 1 > damage_frames_) {
+    repaint = all;
+  } else {
+    for (int i = 0; i < age - 1; i++)
+      repaint = rect_union(repaint, damage_history_[i]);
+  }
+
+  memmove(&damage_history_[1], &damage_history_[0],
+          (kDamageHistory - 1) * sizeof(damage_history_[0]));
+  damage_history_[0] = damage;
+  if (damage_frames_ < kDamageHistory)
+    damage_frames_++;
+
+  GL* gl = WaylandPlatform::getInstance()->getGL();
+  if (repaint.width != all.width || repaint.height != all.height) {
+    // GL puts the origin at the bottom left.
+    gl->state.scissor(repaint.x,
+                      geometry.height - repaint.y - repaint.height,
+                      repaint.width, repaint.height);
+    gl->state.enable(GL_SCISSOR_TEST);
+  }
+  return damage;
+}
+
+void WaylandWindow::swap_buffers(const struct rect& damage) {
+  TRACE_SCOPE("swap");
+  if (!swap_buffers_with_damage_) {
+    eglSwapBuffers(display->egl.dpy, egl_surface);
+    return;
+  }
+  // Also bottom left. No rectangles would mean everything, so an empty
+  // damage is sent as one empty rectangle.
+  EGLint rects[4] = {damage.x, geometry.height - damage.y - damage.height,
+                     std::max(damage.width, 0), std::max(damage.height, 0)};
+  swap_buffers_with_damage_(display->egl.dpy, egl_surface, rects, 1);
+}
+
+void WaylandWindow::set_opaque_region(const struct rect* region) {
+  if (!region ? !has_opaque_region_
+              : has_opaque_region_ && rect_equal(*region, opaque_region_))
+    return;
+  has_opaque_region_ = region != NULL;
+  if (region)
+    opaque_region_ = *region;
+  dirty_ |= kOpaqueRegion;
+}
+
+void WaylandWindow::set_input_region(const struct rect* region) {
+  if (!region ? !has_input_region_
+              : has_input_region_ && rect_equal(*region, input_region_))
+    return;
+  has_input_region_ = region != NULL;
+  if (region)
+    input_region_ = *region;
+  dirty_ |= kInputRegion;
+}
+
+void WaylandWindow::set_buffer_scale(int scale) {
+  if (scale == buffer_scale_)
+    return;
+  buffer_scale_ = scale;
+  dirty_ |= kBufferScale;
+}
+
+void WaylandWindow::set_buffer_transform(int transform) {
+  if (transform == buffer_transform_)
+    return;
+  buffer_transform_ = transform;
+  dirty_ |= kBufferTransform;
+}
+
+struct wl_region* WaylandWindow::create_region(const struct rect& r) {
+  struct wl_region* region =
+      wl_compositor_create_region(display->compositor);
+  wl_region_add(region, r.x, r.y, r.width, r.height);
+  protocol_requests_ += 2;
+  return region;
+}
+
+void WaylandWindow::flush_surface_state() {
+  if (!dirty_)
+    return;
+
+  if (dirty_ & kOpaqueRegion) {
+    struct wl_region* region =
+        has_opaque_region_ ? create_region(opaque_region_) : NULL;
+    wl_surface_set_opaque_region(surface, region);
+    protocol_requests_++;
+    if (region) {
+      wl_region_destroy(region);
+      protocol_requests_++;
+    }
+  }
+  if (dirty_ & kInputRegion) {
+    struct wl_region* region =
+        has_input_region_ ? create_region(input_region_) : NULL;
+    wl_surface_set_input_region(surface, region);
+    protocol_requests_++;
+    if (region) {
+      wl_region_destroy(region);
+      protocol_requests_++;
+    }
+  }
+
+  // Older compositors do not have these; the surface stays at the default.
+  uint32_t version =
+      wl_proxy_get_version(reinterpret_cast<struct wl_proxy*>(surface));
+  if ((dirty_ & kBufferScale) && version >= 3) {
+    wl_surface_set_buffer_scale(surface, buffer_scale_);
+    protocol_requests_++;
+  }
+  if ((dirty_ & kBufferTransform) && version >= 2) {
+    wl_surface_set_buffer_transform(surface, buffer_transform_);
+    protocol_requests_++;
+  }
+  dirty_ = 0;
+}
+
+void WaylandWindow::finish_offscreen_frame(bool gles3) {
+  TRACE_SCOPE("swap");
+  if (!gles3) {
+    glFinish();
+    return;
+  }
+  // Wait for the frame kOffscreenFrames back, so the CPU can run ahead of
+  // the GPU by as much as with a swap chain, and no more.
+  GLsync& fence = offscreen_fences_[offscreen_frame_];
+  if (fence) {
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fence);
+  }
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glFlush();
+  offscreen_frame_ = (offscreen_frame_ + 1) % kOffscreenFrames;
+}
+
+void WaylandWindow::dispatch_frame_queue() {
+  // The events were read before this. A callback they are for was created
+  // before that too, and has its listener once draw_frame() lets go.
+  { std::lock_guard<std::mutex> lock(callback_mutex_); }
+  wl_display_dispatch_queue_pending(display->display_, frame_queue_);
+}
+
+static void dispatch_frames(void* data) {
+  static_cast<WaylandWindow*>(data)->dispatch_frame_queue();
+}
+
+void WaylandWindow::resize(int width, int height) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_size_.width = width;
+  pending_size_.height = height;
+  resize_pending_ = true;
+}
+
+void WaylandWindow::set_damage_tracking(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  damage_tracking_ = enabled;
+  damage_all_ = true;
+}
+
+void WaylandWindow::add_damage(int x, int y, int width, int height) {
+  struct rect r = {x, y, width, height};
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_damage_ = rect_union(pending_damage_, r);
+}
+
+void WaylandWindow::damage_all() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  damage_all_ = true;
 }
 
 static void handle_ping(void* data,
@@ -54,14 +371,12 @@ static void handle_configure(void* data,
                              int32_t height) {
   WaylandWindow* window = static_cast<WaylandWindow*>(data);
 
-  if (window->native)
-    wl_egl_window_resize(window->native, width, height, 0, 0);
-
-  window->geometry.width = width;
-  window->geometry.height = height;
+  window->resize(width, height);
 
-  if (!window->fullscreen)
-    window->window_size = window->geometry;
+  if (!window->fullscreen) {
+    window->window_size.width = width;
+    window->window_size.height = height;
+  }
 }
 
 static void handle_popup_done(void* data,
@@ -79,7 +394,7 @@ static void configure_callback(void* data,
 
   window->configured = 1;
 
-  if (window->callback == NULL)
+  if (!window->frame_pending())
     redraw(data, NULL, time);
 }
 
@@ -87,14 +402,45 @@ static struct wl_callback_listener configure_callback_listener = {
     configure_callback,
 };
 
-WaylandWindow::WaylandWindow() : fullscreen(1), callback(nullptr) {
+WaylandWindow::WaylandWindow()
+    : callback(nullptr),
+      callback_requested(0),
+      fullscreen(1),
+      opaque(0),
+      updatePtr(nullptr),
+      render_thread(nullptr),
+      present_mode(kPresentFifo),
+      resize_pending_(false),
+      damage_tracking_(false),
+      damage_all_(false),
+      pending_damage_{0, 0, 0, 0},
+      damage_frames_(0),
+      buffer_age_(false),
+      swap_buffers_with_damage_(nullptr),
+      has_opaque_region_(false),
+      opaque_region_{0, 0, 0, 0},
+      has_input_region_(false),
+      input_region_{0, 0, 0, 0},
+      buffer_scale_(1),
+      buffer_transform_(WL_OUTPUT_TRANSFORM_NORMAL),
+      dirty_(0),
+      protocol_requests_(0),
+      framebuffer_(0),
+      color_texture_(0),
+      depth_buffer_(0),
+      offscreen_fences_{},
+      offscreen_frame_(0),
+      swap_mode_(kPresentFifo),
+      frame_queue_(nullptr),
+      surface_wrapper_(nullptr),
+      display_wrapper_(nullptr) {
 
 }
 
 void WaylandWindow::toggle_fullscreen() {
   struct wl_callback* callback;
 
-  fullscreen = fullscreen^1;
+  fullscreen.store(fullscreen.load() ^ 1);
   configured = 0;
 
   if (fullscreen) {
@@ -124,20 +470,138 @@ void WaylandWindow::create_surface(unsigned width, unsigned height) {
   wl_shell_surface_add_listener(shell_surface, &shell_surface_listener,
                                 this);
 
+  frame_queue_ = wl_display_create_queue(display->display_);
+  surface_wrapper_ =
+      static_cast<struct wl_surface*>(wl_proxy_create_wrapper(surface));
+  wl_proxy_set_queue(reinterpret_cast<struct wl_proxy*>(surface_wrapper_),
+                     frame_queue_);
+  display_wrapper_ = static_cast<struct wl_display*>(
+      wl_proxy_create_wrapper(display->display_));
+  wl_proxy_set_queue(reinterpret_cast<struct wl_proxy*>(display_wrapper_),
+                     frame_queue_);
+  display->loop.set_dispatch_callback(dispatch_frames, this);
+
   native = wl_egl_window_create(
       surface, window_size.width, window_size.height);
   egl_surface = eglCreateWindowSurface(
      display->egl.dpy, display->egl.conf, (EGLNativeWindowType)native, NULL);
 
   wl_shell_surface_set_title(shell_surface, "simple-egl");
+  scheduler.init(display->presentation, display->presentation_clock);
 
   ret = eglMakeCurrent(display->egl.dpy, egl_surface,
                        egl_surface, display->egl.ctx);
   assert(ret == EGL_TRUE);
 
+  const char* extensions = eglQueryString(display->egl.dpy, EGL_EXTENSIONS);
+  buffer_age_ = extensions && strstr(extensions, "EGL_EXT_buffer_age");
+  if (extensions && strstr(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+    swap_buffers_with_damage_ = reinterpret_cast<
+        PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(
+        eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+  } else if (extensions &&
+             strstr(extensions, "EGL_EXT_swap_buffers_with_damage")) {
+    swap_buffers_with_damage_ = reinterpret_cast<
+        PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(
+        eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+  }
+
   toggle_fullscreen();
 }
 
+void WaylandWindow::create_offscreen(unsigned width, unsigned height) {
+  EGLBoolean ret;
+
+  window_size.width = width;
+  window_size.height = height;
+  geometry = window_size;
+  native = NULL;
+  surface = NULL;
+  shell_surface = NULL;
+  fullscreen = 0;
+  configured = 1;
+
+  // A context needs a surface to be current, unless EGL says otherwise.
+  egl_surface = EGL_NO_SURFACE;
+  const char* extensions = eglQueryString(display->egl.dpy, EGL_EXTENSIONS);
+  if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+    static const EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1,
+                                             EGL_NONE};
+    egl_surface = eglCreatePbufferSurface(display->egl.dpy, display->egl.conf,
+                                          pbuffer_attribs);
+    assert(egl_surface != EGL_NO_SURFACE);
+  }
+  ret = eglMakeCurrent(display->egl.dpy, egl_surface, egl_surface,
+                       display->egl.ctx);
+  assert(ret == EGL_TRUE);
+
+  // A texture rather than a renderbuffer, since ES 2 has no RGBA8
+  // renderbuffers.
+  glGenTextures(1, &color_texture_);
+  glBindTexture(GL_TEXTURE_2D, color_texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenRenderbuffers(1, &depth_buffer_);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  // Stays bound; nothing else draws to another framebuffer.
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         color_texture_, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth_buffer_);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "Error: offscreen framebuffer is incomplete\n");
+    exit(1);
+  }
+}
+
+void WaylandWindow::write_offscreen(const char* path) {
+  int width = geometry.width;
+  int height = geometry.height;
+  std::vector<GLubyte> pixels(width * height * 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    perror(path);
+    return;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  // GL rows go bottom up.
+  for (int y = height - 1; y >= 0; y--) {
+    for (int x = 0; x < width; x++)
+      fwrite(&pixels[(y * width + x) * 4], 1, 3, file);
+  }
+  fclose(file);
+}
+
+void WaylandWindow::destroy_offscreen() {
+  const char* path = getenv("OPENGL_WAYLAND_HEADLESS_DUMP");
+  if (path)
+    write_offscreen(path);
+
+  for (int i = 0; i < kOffscreenFrames; i++) {
+    if (offscreen_fences_[i])
+      glDeleteSync(offscreen_fences_[i]);
+    offscreen_fences_[i] = 0;
+  }
+  glDeleteFramebuffers(1, &framebuffer_);
+  glDeleteRenderbuffers(1, &depth_buffer_);
+  glDeleteTextures(1, &color_texture_);
+
+  // Still current, so EGL frees it once finish_egl() releases the context.
+  if (egl_surface != EGL_NO_SURFACE)
+    eglDestroySurface(display->egl.dpy, egl_surface);
+}
+
 void WaylandWindow::destroy_surface() {
   /* Required, otherwise segfault in egl_dri2.c: dri2_make_current()
    * on eglReleaseThread(). */
@@ -148,10 +612,14 @@ void WaylandWindow::destroy_surface() {
   wl_egl_window_destroy(native);
 
   wl_shell_surface_destroy(shell_surface);
+  wl_proxy_wrapper_destroy(surface_wrapper_);
+  wl_proxy_wrapper_destroy(display_wrapper_);
   wl_surface_destroy(surface);
 
-  if (callback)
-    wl_callback_destroy(callback);
+  if (callback.load())
+    wl_callback_destroy(callback.load());
+  wl_event_queue_destroy(frame_queue_);
+  scheduler.destroy();
 }
 
 void usage(int error_code) {
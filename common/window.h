@@ -1,11 +1,38 @@
 #ifndef WINDOW_H_
 #define WINDOW_H_
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
 
+#include <atomic>
+#include <mutex>
+
+#include "benchmark.h"
 #include "display.h"
+#include "frame_clock.h"
+#include "frame_scheduler.h"
+
+class RenderQueue;
+class RenderThread;
 
-static int running = 1;
+// How frames reach the screen.
+enum PresentMode {
+  // Swap interval 1, and a frame is drawn on each frame callback. Both
+  // throttle to the display, so eglSwapBuffers can block in the driver on
+  // top of the wait for the callback, and a late frame waits a whole
+  // extra refresh.
+  kPresentFifo,
+  // Swap interval 0, and a frame is drawn on each frame callback. Only the
+  // callback throttles; eglSwapBuffers returns at once.
+  kPresentFrameCallback,
+  // Swap interval 0, and the next frame starts as soon as the compositor
+  // has seen the last commit, without waiting for a frame callback. The
+  // compositor shows the newest frame at each refresh and drops the
+  // others. Uncapped; for benchmarks.
+  kPresentMailbox,
+};
 
 typedef struct {
    GLfloat   m[4][4];
@@ -15,12 +42,54 @@ struct geometry {
   int width, height;
 };
 
+// In surface coordinates, with the origin at the top left.
+struct rect {
+  int x, y, width, height;
+};
+
 class WaylandWindow {
  public:
   WaylandWindow();
   void create_surface(unsigned width, unsigned height);
   void destroy_surface();
+  // Renders into a framebuffer object instead, for a headless display.
+  // With OPENGL_WAYLAND_HEADLESS_DUMP set to a path, destroy_offscreen()
+  // writes the last frame there as a PPM image.
+  void create_offscreen(unsigned width, unsigned height);
+  void destroy_offscreen();
   void toggle_fullscreen();
+  // Starts a frame, on the render thread if there is one. Called on the
+  // event thread.
+  void frame_due();
+  // Whether a frame callback is coming, or a frame that will ask for one
+  // is on its way. Called on the event thread.
+  bool frame_pending();
+  // Draws and swaps one frame, replaying |frame| if it is not NULL. Runs on
+  // the render thread once there is one.
+  void draw_frame(RenderQueue* frame);
+  // Called on the event thread with the size the compositor asked for.
+  void resize(int width, int height);
+  // Dispatches the frame callbacks. Called on the event thread.
+  void dispatch_frame_queue();
+
+  // With damage tracking on, a frame only repaints what changed since the
+  // buffer it draws into was last drawn, and only that much is presented.
+  // Off by default: every frame repaints and presents the whole surface.
+  void set_damage_tracking(bool enabled);
+  // Marks part of the surface as changed for the next frame. May be called
+  // from any thread.
+  void add_damage(int x, int y, int width, int height);
+  void damage_all();
+
+  // Surface state, sent with the next commit only when it changed. Called
+  // from drawPtr, or before run(). A NULL opaque region means none, and a
+  // NULL input region means the whole surface.
+  void set_opaque_region(const struct rect* region);
+  void set_input_region(const struct rect* region);
+  void set_buffer_scale(int scale);
+  void set_buffer_transform(int transform);
+  // Requests the window has sent, not counting those EGL sends to swap.
+  unsigned protocol_requests() const { return protocol_requests_; }
 
   WaylandDisplay* display;
   struct geometry geometry, window_size;
@@ -28,11 +97,97 @@ class WaylandWindow {
   struct wl_surface* surface;
   struct wl_shell_surface* shell_surface;
   EGLSurface egl_surface;
-  struct wl_callback* callback;
-  int fullscreen;
+  // The frame callback asked for, if any. Set on the render thread and
+  // cleared on the event thread when it is done.
+  std::atomic<struct wl_callback*> callback;
+  // When the callback was asked for, to trace how long it took.
+  std::atomic<int64_t> callback_requested;
+  // Set on the event thread and read on the render thread.
+  std::atomic<int> fullscreen;
   int configured;
-  int opaque;
+  std::atomic<int> opaque;
   void (*drawPtr)(WaylandWindow*);
+  // Optional. Updates the scene and records its draws without making GL
+  // calls, so that it can run on another thread while the previous frame
+  // is drawn.
+  void (*updatePtr)(WaylandWindow*, RenderQueue*);
+  // Draws the frames once run() starts it, or NULL.
+  RenderThread* render_thread;
+  // Presentation feedback, and when to start drawing.
+  FrameScheduler scheduler;
+  PresentMode present_mode;
+  // The time to animate the frame being drawn at.
+  FrameClock clock;
+  // Measures the frames with --bench.
+  Benchmark benchmark;
+  // The part of the buffer drawPtr has to repaint. Rendering is scissored
+  // to it, so drawPtr may still draw everything.
+  struct rect repaint;
+
+ private:
+  // Frames whose damage is kept, for buffers that many frames old.
+  static const int kDamageHistory = 4;
+  // Headless frames the GPU may still be working on, like a swap chain.
+  static const int kOffscreenFrames = 2;
+
+  enum SurfaceState {
+    kOpaqueRegion = 1 << 0,
+    kInputRegion = 1 << 1,
+    kBufferScale = 1 << 2,
+    kBufferTransform = 1 << 3,
+  };
+
+  // Sends the surface state marked dirty.
+  void flush_surface_state();
+  struct wl_region* create_region(const struct rect& r);
+
+  // Finds what this frame repaints, and scissors to it.
+  struct rect begin_damage();
+  void swap_buffers(const struct rect& damage);
+  // Stands in for the swap when headless.
+  void finish_offscreen_frame(bool gles3);
+  void write_offscreen(const char* path);
+
+  // Guards the pending size and damage, which come from other threads.
+  std::mutex mutex_;
+  // The size from the last configure, applied by the next frame so that
+  // the surface is not resized while it is being drawn.
+  struct geometry pending_size_;
+  bool resize_pending_;
+  bool damage_tracking_;
+  bool damage_all_;
+  struct rect pending_damage_;
+  // Only touched while drawing. The damage of the last frames, newest
+  // first.
+  struct rect damage_history_[kDamageHistory];
+  int damage_frames_;
+  bool buffer_age_;
+  PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_buffers_with_damage_;
+  // Surface state as last set, and which of it has not been sent.
+  bool has_opaque_region_;
+  struct rect opaque_region_;
+  bool has_input_region_;
+  struct rect input_region_;
+  int buffer_scale_;
+  int buffer_transform_;
+  unsigned dirty_;
+  unsigned protocol_requests_;
+  // The headless render target.
+  GLuint framebuffer_;
+  GLuint color_texture_;
+  GLuint depth_buffer_;
+  GLsync offscreen_fences_[kOffscreenFrames];
+  int offscreen_frame_;
+  // The mode the swap interval was last set for.
+  PresentMode swap_mode_;
+  // Frame callbacks are created on the render thread, from wrappers of
+  // the surface and, for the mailbox mode's sync, of the display, onto a
+  // queue of their own. The event thread dispatches it only once the
+  // listener is set; draw_frame() holds |callback_mutex_| until then.
+  struct wl_event_queue* frame_queue_;
+  struct wl_surface* surface_wrapper_;
+  struct wl_display* display_wrapper_;
+  std::mutex callback_mutex_;
 };
 
 #endif